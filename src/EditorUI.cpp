@@ -1,8 +1,10 @@
 #include "EditorUI.h"
+#include "TextSearch.h"
 #include "Tooling.h"
 #include "../vendor/imgui/imgui.h"
 #include "../vendor/imgui/imgui_internal.h"
 #include "../vendor/stb/stb_sprintf.h"
+#include <algorithm>
 #include <iostream>
 
 namespace UI {
@@ -87,18 +89,242 @@ namespace UI {
   
   int EditorUI::getLineMaxColumn(int l) const {
     PROFILE_START;
-    if (l >= lines.size()) return 0;
-    auto& line = lines[l];
+    if (l >= buffer.lineCount()) return 0;
+    return getLineLayout(l).maxColumn;
+  }
+  
+  const EditorUI::LineLayout& EditorUI::getLineLayout(int l) const {
+    if (l >= (int)lineLayouts.size()) {
+      lineLayouts.resize(buffer.lineCount());
+    }
+    
+    auto& cached = lineLayouts[l];
+    if (cached) {
+      return *cached;
+    }
+    
+    PROFILE_START_NAMED("EditorUI::buildLineLayout");
+    cached = std::make_unique<LineLayout>();
+    auto& layout = *cached;
+    
+    std::string_view line;
+    if (!buffer.lineView(l, line)) {
+      // Lines spread over several pieces are joined once here instead of
+      // every time they are drawn.
+      layout.joined = true;
+      auto start = buffer.lineStart(l);
+      layout.text = buffer.getText(start, start + buffer.lineLength(l));
+      line = layout.text;
+    }
+    
+    layout.size = (int)line.size();
+    layout.simple = true;
+    for (auto c : line) {
+      if (c == '\t' || (uint8_t)c >= 0x80) {
+        layout.simple = false;
+        break;
+      }
+    }
+    
+    if (layout.simple) {
+      layout.maxColumn = layout.size;
+      return layout;
+    }
+    
+    layout.indexToColumn.resize(line.size() + 1);
+    layout.columnToIndex.reserve(line.size() + 1);
+    
     int col = 0;
-    for (unsigned i = 0; i < line.size();) {
-      auto c = line[i].m_char;
-      if (c == '\t')
-        col = (col / tabSize) * tabSize + tabSize;
-      else
-        col++;
-      i += UTF8CharLength(c);
+    for (int i = 0; i < (int)line.size();) {
+      // Columns up to this glyph's start resolve to the glyph itself.
+      while ((int)layout.columnToIndex.size() <= col) {
+        layout.columnToIndex.push_back(i);
+      }
+      
+      auto c = (uint8_t)line[i];
+      auto next = std::min(i + UTF8CharLength(c), (int)line.size());
+      auto nextCol = c == '\t' ? (col / tabSize) * tabSize + tabSize : col + 1;
+      
+      layout.indexToColumn[i] = col;
+      for (int j = i + 1; j < next; j++) {
+        layout.indexToColumn[j] = nextCol;
+      }
+      
+      col = nextCol;
+      i = next;
+    }
+    
+    while ((int)layout.columnToIndex.size() <= col) {
+      layout.columnToIndex.push_back((int)line.size());
     }
-    return col;
+    layout.indexToColumn[line.size()] = col;
+    layout.maxColumn = col;
+    return layout;
+  }
+  
+  std::string_view EditorUI::getLineText(int l) const {
+    if (l < 0 || l >= buffer.lineCount()) {
+      return {};
+    }
+    
+    auto& layout = getLineLayout(l);
+    if (layout.joined) {
+      return layout.text;
+    }
+    
+    std::string_view view;
+    buffer.lineView(l, view);
+    return view;
+  }
+  
+  const std::vector<float>& EditorUI::getLineOffsets(int l) const {
+    auto& glyphs = getGlyphCache();
+    getLineLayout(l);
+    auto& layout = *lineLayouts[l];
+    if (layout.offsetsGeneration == glyphs.generation) {
+      return layout.offsets;
+    }
+    
+    PROFILE_START_NAMED("EditorUI::buildLineOffsets");
+    auto line = getLineText(l);
+    float tabWidth = float(tabSize) * glyphs.spaceWidth;
+    
+    // offsets[i] is the x position of byte i. Continuation bytes share the
+    // position of the following glyph, like indexToColumn does.
+    layout.offsets.resize(line.size() + 1);
+    float x = 0.0f;
+    for (int i = 0; i < (int)line.size();) {
+      layout.offsets[i] = x;
+      if (line[i] == '\t') {
+        x = (1.f + std::floor((1.f + x) / tabWidth)) * tabWidth;
+        i++;
+        continue;
+      }
+      
+      auto d = std::min(UTF8CharLength(line[i]), (int)line.size() - i);
+      x += glyphs.advance(&line[i], d);
+      for (int j = i + 1; j < i + d; j++) {
+        layout.offsets[j] = x;
+      }
+      i += d;
+    }
+    layout.offsets[line.size()] = x;
+    layout.offsetsGeneration = glyphs.generation;
+    return layout.offsets;
+  }
+  
+  float EditorUI::measureLineWidth(int l) const {
+    float tabWidth = float(tabSize) * glyphCache.spaceWidth;
+    std::string_view line;
+    if (!buffer.lineView(l, line)) {
+      line = buffer.line(l);
+    }
+    
+    float x = 0.0f;
+    for (int i = 0; i < (int)line.size();) {
+      if (line[i] == '\t') {
+        x = (1.f + std::floor((1.f + x) / tabWidth)) * tabWidth;
+        i++;
+        continue;
+      }
+      
+      auto d = std::min(UTF8CharLength(line[i]), (int)line.size() - i);
+      x += glyphCache.advance(&line[i], d);
+      i += d;
+    }
+    return x;
+  }
+  
+  float EditorUI::getLongestLineWidth() {
+    auto& glyphs = getGlyphCache();
+    if (lineWidthsGeneration != glyphs.generation ||
+        (int)lineWidths.size() != buffer.lineCount()) {
+      PROFILE_START_NAMED("EditorUI::measureAllLines");
+      lineWidths.resize(buffer.lineCount());
+      lineWidthSet.clear();
+      for (int i = 0; i < buffer.lineCount(); i++) {
+        lineWidths[i] = measureLineWidth(i);
+        lineWidthSet.insert(lineWidths[i]);
+      }
+      lineWidthsGeneration = glyphs.generation;
+    }
+    return *lineWidthSet.rbegin();
+  }
+  
+  void EditorUI::updateLineWidths(int first, int removed, int added) {
+    // Until the first frame has measured everything there is nothing to
+    // keep up to date.
+    if (lineWidths.empty() || lineWidthsGeneration != glyphCache.generation) {
+      return;
+    }
+    
+    auto end = std::min(first + removed, (int)lineWidths.size());
+    for (int i = first; i < end; i++) {
+      lineWidthSet.erase(lineWidthSet.find(lineWidths[i]));
+    }
+    lineWidths.erase(lineWidths.begin() + first, lineWidths.begin() + end);
+    lineWidths.insert(lineWidths.begin() + first, added, 0.0f);
+    
+    for (int i = first; i < first + added; i++) {
+      lineWidths[i] = measureLineWidth(i);
+      lineWidthSet.insert(lineWidths[i]);
+    }
+  }
+  
+  void EditorUI::invalidateLines(int first, int removed, int added) {
+    updateLineWidths(first, removed, added);
+    
+    if (first >= (int)lineLayouts.size()) {
+      return;
+    }
+    
+    auto end = std::min(first + removed, (int)lineLayouts.size());
+    auto kept = std::min(end - first, added);
+    for (int i = first; i < first + kept; i++) {
+      lineLayouts[i].reset();
+    }
+    
+    if (added > kept) {
+      auto count = added - kept;
+      lineLayouts.resize(lineLayouts.size() + count);
+      std::move_backward(lineLayouts.begin() + first + kept, lineLayouts.end() - count, lineLayouts.end());
+    } else if (end > first + kept) {
+      lineLayouts.erase(lineLayouts.begin() + first + kept, lineLayouts.begin() + end);
+    }
+    
+    if ((int)lineLayouts.size() > buffer.lineCount()) {
+      lineLayouts.resize(buffer.lineCount());
+    }
+  }
+  
+  void EditorUI::insertBytes(size_t offset, const char *text, size_t length) {
+    offset = std::min(offset, buffer.size());
+    auto line = buffer.lineOfOffset(offset);
+    auto added = (int)std::count(text, text + length, '\n');
+    
+    buffer.insert(offset, text, length);
+    invalidateLines(line, 1, added + 1);
+    shiftSearchResults(offset, 0, length);
+    textChanged = true;
+  }
+  
+  void EditorUI::eraseBytes(size_t offset, size_t length) {
+    if (offset >= buffer.size()) {
+      return;
+    }
+    length = std::min(length, buffer.size() - offset);
+    auto first = buffer.lineOfOffset(offset);
+    auto last = buffer.lineOfOffset(offset + length);
+    
+    buffer.erase(offset, length);
+    invalidateLines(first, last - first + 1, 1);
+    shiftSearchResults(offset, length, 0);
+    textChanged = true;
+  }
+  
+  GlyphCache& EditorUI::getGlyphCache() const {
+    glyphCache.setFont(ImGui::GetFont(), ImGui::GetFontSize());
+    return glyphCache;
   }
   
   inline int EditorUI::getPageSize() const {
@@ -108,55 +334,36 @@ namespace UI {
   
   int EditorUI::getCharacterIndex(const EditorUI::Coordinate& from) const {
     PROFILE_START;
-    if (from.line >= lines.size()) return -1;
-    auto& line = lines[from.line];
-    int c = 0;
-    int i = 0;
-    for (; i < line.size() && c < from.column;) {
-      if (line[i].m_char == '\t') {
-        c = (c / tabSize) * tabSize + tabSize;
-      } else {
-        ++c;
-      }
-      i += UTF8CharLength(line[i].m_char);
+    if (from.line >= buffer.lineCount()) return -1;
+    auto& layout = getLineLayout(from.line);
+    if (from.column >= layout.maxColumn) {
+      return layout.size;
     }
-    return i;
+    if (layout.simple) {
+      return std::max(0, from.column);
+    }
+    return layout.columnToIndex[std::max(0, from.column)];
+  }
+  
+  size_t EditorUI::getOffset(const EditorUI::Coordinate& from) const {
+    if (from.line >= buffer.lineCount()) {
+      return buffer.size();
+    }
+    return buffer.lineStart(from.line) + getCharacterIndex(from);
+  }
+  
+  EditorUI::Coordinate EditorUI::getCoordinate(size_t offset) const {
+    auto line = buffer.lineOfOffset(offset);
+    return Coordinate(line, getCharacterColumn(line, (int)(offset - buffer.lineStart(line))));
   }
   
   float EditorUI::textDistanceToLineStart(const EditorUI::Coordinate& from) const {
     PROFILE_START;
-    auto& line = lines[from.line];
-    
-    float distance = 0.0f;
-    float spaceSize = ImGui::GetFont()
-      ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f,
-                      " ", nullptr, nullptr)
-      .x;
-    
     int colIndex = getCharacterIndex(from);
-    
-    for (size_t i = 0u; i < line.size() && i < colIndex;) {
-      if (line[i].m_char == '\t') {
-        distance = (1.f + std::floor((1.f + distance) /
-                                     (float(tabSize) * spaceSize))) *
-          (float(tabSize) * spaceSize);
-        i++;
-      } else {
-        // TODO: Cache this
-        auto d = UTF8CharLength(line[i].m_char);
-        char tempCString[7];
-        int j = 0;
-        for (; j < 6 && d-- > 0 && i < (int)line.size(); i++, j++) {
-          tempCString[j] = line[i].m_char;
-        }
-        tempCString[j] = '\0';
-        distance += ImGui::GetFont()
-          ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f,
-                          tempCString, nullptr, nullptr)
-          .x;
-      }
+    if (colIndex < 0) {
+      return 0.0f;
     }
-    return distance;
+    return getLineOffsets(from.line)[colIndex];
   }
   
   void EditorUI::createUIRange(const Coordinate& from, const Coordinate& to, Coordinate& lineStart, Coordinate& lineEnd, float& start, float& end, int lineNo) {
@@ -179,13 +386,21 @@ namespace UI {
   
   void inline EditorUI::deleteLine(int start, int end) {
     PROFILE_START;
-    lines.erase(lines.begin() + start, lines.begin() + end);
+    if (end < buffer.lineCount()) {
+      auto from = buffer.lineStart(start);
+      eraseBytes(from, buffer.lineStart(end) - from);
+    } else if (start > 0) {
+      // The last line has no line feed of its own, take the previous one.
+      auto from = buffer.lineStart(start) - 1;
+      eraseBytes(from, buffer.size() - from);
+    } else {
+      eraseBytes(0, buffer.size());
+    }
     textChanged = true;
   }
   
   void inline EditorUI::deleteLine(int index) {
-    lines.erase(lines.begin() + index);
-    textChanged = true;
+    deleteLine(index, index + 1);
   }
   
   void EditorUI::deleteRange(const Coordinate& from, const Coordinate& to) {
@@ -198,97 +413,47 @@ namespace UI {
       return;
     }
     
-    auto start = getCharacterIndex(from);
-    auto end = getCharacterIndex(to);
+    auto start = getOffset(from);
+    auto end = getOffset(to);
     
-    if (from.line == to.line) {
-      auto& line = lines[from.line];
-      auto n = getLineMaxColumn(from.line);
-      if (to.column >= n) {
-        line.erase(line.begin() + start, line.end());
-      } else {
-        line.erase(line.begin() + start, line.begin() + end);
-      }
-    } else {
-      auto& firstLine = lines[from.line];
-      auto& lastLine = lines[to.line];
-      
-      firstLine.erase(firstLine.begin() + start, firstLine.end());
-      lastLine.erase(lastLine.begin(), lastLine.begin() + end);
-      
-      if (from.line < to.line) {
-        firstLine.insert(firstLine.end(), lastLine.begin(), lastLine.end());
-        deleteLine(from.line + 1, to.line + 1);
-      }
+    if (end > start) {
+      eraseBytes(start, end - start);
     }
     textChanged = true;
   }
   
   std::string EditorUI::getText(const Coordinate& from, const Coordinate& to) const {
     PROFILE_START;
-    std::string result;
-    
-    int lStart = from.line;
-    int lEnd = to.line;
-    int cIndexStart = getCharacterIndex(from);
-    int cIndexEnd = getCharacterIndex(to);
-    
-    size_t s = 0;
-    
-    for (size_t i = lStart; i < lEnd; i++) {
-      s += lines[i].size();
-    }
-    
-    result.reserve(s + s / 8);
-    
-    while (cIndexStart < cIndexEnd || lStart < lEnd) {
-      if(lStart >= (int)lines.size()) {
-        break;
-      }
-      
-      auto& line = lines[lStart];
-      if(cIndexStart < (int)line.size()) {
-        result += line[cIndexStart].m_char;
-        cIndexStart++;
-      } else {
-        cIndexStart = 0;
-        ++lStart;
-        result+= "\n";
-      }
-    }
-    
-    return result;
+    return buffer.getText(getOffset(from), getOffset(to));
   }
   
   void EditorUI::setText(const string& text) {
     PROFILE_START;
-    lines.clear();
-    lines.emplace_back(Line());
-    for (auto character : text) {
-      if (character == '\r') {
-      } else if (character == '\n') {
-        lines.emplace_back(Line());
-      } else {
-        lines.back().emplace_back(Glypth(character));
-      }
-    }
+    buffer.setText(text);
+    lineLayouts.clear();
+    lineWidths.clear();
+    // Cached hits are offsets into the old text.
+    searchCache.clear();
+  }
+  
+  void EditorUI::setText(const char *data, size_t size) {
+    PROFILE_START;
+    buffer.setText(data, size);
+    lineLayouts.clear();
+    lineWidths.clear();
+    searchCache.clear();
   }
   
   EditorUI::Coordinate EditorUI::sanitizeCoordinates(const Coordinate& value) const {
     PROFILE_START;
     int line = value.line;
     int column = value.column;
-    if (line >= (int)lines.size()) {
-      if (lines.empty()) {
-        line = 0;
-        column = 0;
-      } else {
-        line = (int)lines.size() - 1;
-        column = getLineMaxColumn(line);
-      }
+    if (line >= buffer.lineCount()) {
+      line = buffer.lineCount() - 1;
+      column = getLineMaxColumn(line);
       return {line, column};
     }
-    column = lines.empty() ? 0 : std::min(column, getLineMaxColumn(line));
+    column = std::min(column, getLineMaxColumn(line));
     return {line, column};
   }
   
@@ -301,44 +466,27 @@ namespace UI {
     
     int columnCoord = 0;
     
-    if (lineNo >= 0 && lineNo < (int)lines.size()) {
-      auto& line = lines.at(lineNo);
-      
-      int columnIndex = 0;
-      float columnX = 0.0f;
+    if (lineNo >= 0 && lineNo < buffer.lineCount()) {
+      auto& offsets = getLineOffsets(lineNo);
+      auto& layout = getLineLayout(lineNo);
+      float x = local.x - textStartPixel;
       
-      while ((size_t)columnIndex < line.size()) {
-        float columnWidth = 0.0f;
-        
-        if (line[columnIndex].m_char == '\t') {
-          float spaceSize =
-            ImGui::GetFont()
-            ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ")
-            .x;
-          float oldX = columnX;
-          float newColumnX = (1.0f + std::floor((1.0f + columnX) /
-                                                (float(tabSize) * spaceSize))) *
-            (float(tabSize) * spaceSize);
-          columnWidth = newColumnX - oldX;
-          if (textStartPixel + columnX + columnWidth * 0.5f > local.x) break;
-          columnX = newColumnX;
-          columnCoord = (columnCoord / tabSize) * tabSize + tabSize;
-          columnIndex++;
+      // Midpoints between neighbouring offsets never decrease, so the first
+      // byte whose glyph is past x by more than half its width is found by
+      // bisection.
+      int size = (int)offsets.size() - 1;
+      int lo = 0;
+      int hi = size;
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if ((offsets[mid] + offsets[mid + 1]) * 0.5f > x) {
+          hi = mid;
         } else {
-          char buf[7];
-          auto d = UTF8CharLength(line[columnIndex].m_char);
-          int i = 0;
-          while (i < 6 && d-- > 0) buf[i++] = line[columnIndex++].m_char;
-          buf[i] = '\0';
-          columnWidth =
-            ImGui::GetFont()
-            ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf)
-            .x;
-          if (textStartPixel + columnX + columnWidth * 0.5f > local.x) break;
-          columnX += columnWidth;
-          columnCoord++;
+          lo = mid + 1;
         }
       }
+      
+      columnCoord = layout.simple ? lo : layout.indexToColumn[lo];
     }
     
     return sanitizeCoordinates(Coordinate(lineNo, columnCoord));
@@ -346,26 +494,26 @@ namespace UI {
   
   EditorUI::Coordinate EditorUI::findWordEnd(const Coordinate& from) const {
     PROFILE_START;
-    if (from.line >= (int)lines.size()) {
+    if (from.line >= buffer.lineCount()) {
       return from;
     }
     
-    auto& line = lines[from.line];
+    auto line = buffer.line(from.line);
     auto cindex = getCharacterIndex(from);
     
     if (cindex >= (int)line.size()) {
       return from;
     }
     
-    bool prevSpace = (bool)isspace(line[cindex].m_char);
+    bool prevSpace = (bool)isspace((uint8_t)line[cindex]);
     
     while (cindex < (int)line.size()) {
-      auto c = line[cindex].m_char;
+      uint8_t c = line[cindex];
       auto d = UTF8CharLength(c);
       
       if (prevSpace != !!isspace(c)) {
         if (isspace(c)) {
-          while (cindex < (int)line.size() && isspace(line[cindex].m_char)) {
+          while (cindex < (int)line.size() && isspace((uint8_t)line[cindex])) {
             ++cindex;
           }
           
@@ -380,11 +528,11 @@ namespace UI {
   
   EditorUI::Coordinate EditorUI::findWordStart(const Coordinate& from) const {
     PROFILE_START;
-    if (from.line >= (int)lines.size()) {
+    if (from.line >= buffer.lineCount()) {
       return from;
     }
     
-    auto& line = lines[from.line];
+    auto line = buffer.line(from.line);
     auto cindex = getCharacterIndex(from);
     
     if (cindex >= (int)line.size()) {
@@ -392,7 +540,7 @@ namespace UI {
     }
     
     bool moved = false;
-    while (cindex > 0 && isspace(line[cindex].m_char)) {
+    while (cindex > 0 && isspace((uint8_t)line[cindex])) {
       cindex--;
       moved = true;
     }
@@ -403,7 +551,7 @@ namespace UI {
     
     moved = false;
     
-    while(cindex > 0 && !isANWord(line[cindex].m_char)) {
+    while(cindex > 0 && !isANWord(line[cindex])) {
       cindex--;
       moved = true;
     }
@@ -417,7 +565,7 @@ namespace UI {
         return {from.line, getCharacterColumn(from.line, cindex)};
       }
       
-      auto c = line[cindex].m_char;
+      auto c = line[cindex];
       
       if(isANWord(c)) {
         cindex--;
@@ -431,18 +579,18 @@ namespace UI {
   
   bool EditorUI::isOnWordBoundary(const Coordinate& at) const {
     PROFILE_START;
-    if (at.line >= (int)lines.size() || at.column == 0) {
+    if (at.line >= buffer.lineCount() || at.column == 0) {
       return true;
     }
     
-    auto& line = lines[at.line];
+    auto line = buffer.line(at.line);
     auto cindex = getCharacterIndex(at);
     
     if (cindex >= (int)line.size()) {
       return true;
     }
     
-    return isspace(line[cindex].m_char) != isspace(line[cindex - 1].m_char);
+    return isspace((uint8_t)line[cindex]) != isspace((uint8_t)line[cindex - 1]);
   }
   
   void EditorUI::setSelection(const Coordinate& start, const Coordinate& end,
@@ -472,8 +620,6 @@ namespace UI {
       }
       case SelectionMode::Line: {
         const auto lineNo = editorState.selectionEnd.line;
-        const auto lineSize =
-          (size_t)lineNo < lines.size() ? lines[lineNo].size() : 0;
         editorState.selectionStart =
           Coordinate(editorState.selectionStart.line, 0);
         editorState.selectionEnd =
@@ -597,23 +743,36 @@ namespace UI {
     ensureCursorVisible();
   }
   
+  void EditorUI::setCursorOffset(size_t offset) {
+    editorState.cursorPosition = getCoordinate(std::min(offset, buffer.size()));
+    ensureCursorVisible();
+  }
+  
+  void EditorUI::setCursorLine(int line, size_t byteColumn) {
+    line = std::clamp(line, 0, std::max(0, buffer.lineCount() - 1));
+    setCursorOffset(buffer.lineStart(line) + std::min(byteColumn, buffer.lineLength(line)));
+  }
+  
   int EditorUI::getCharacterColumn(int lineIndex, int index) const {
     PROFILE_START;
-    if (lineIndex >= lines.size()) {
+    if (lineIndex >= buffer.lineCount()) {
       return 0;
     }
-    auto& line = lines[lineIndex];
-    int col = 0;
-    int i = 0;
-    while (i < index && i < (int)line.size()) {
-      auto c = line[i].m_char;
-      i += UTF8CharLength(c);
-      if (c == '\t')
-        col = (col / tabSize) * tabSize + tabSize;
-      else
-        col++;
+    
+    // Plain ASCII up to the index maps one to one, which spares building a
+    // layout for every line a search hit lands on.
+    if (lineIndex >= (int)lineLayouts.size() || !lineLayouts[lineIndex]) {
+      std::string_view line;
+      if (index >= 0 && buffer.lineView(lineIndex, line) && index <= (int)line.size() &&
+          std::none_of(line.begin(), line.begin() + index,
+                       [](char c) { return c == '\t' || (uint8_t)c >= 0x80; })) {
+        return index;
+      }
     }
-    return col;
+    
+    auto& layout = getLineLayout(lineIndex);
+    index = std::max(0, std::min(index, layout.size));
+    return layout.simple ? index : layout.indexToColumn[index];
   }
   
   void EditorUI::moveUp(int amount, bool shift) {
@@ -644,7 +803,7 @@ namespace UI {
     PROFILE_START;
     auto oldPos = editorState.cursorPosition;
     editorState.cursorPosition.line =
-      std::max(0, std::min((int)lines.size() - 1,
+      std::max(0, std::min(buffer.lineCount() - 1,
                            editorState.cursorPosition.line + amount));
     
     if (editorState.cursorPosition != oldPos) {
@@ -667,10 +826,6 @@ namespace UI {
   
   void EditorUI::moveLeft(int amount, bool shift, bool ctrl) {
     PROFILE_START;
-    if (lines.empty()) {
-      return;
-    }
-    
     auto oldPos = editorState.cursorPosition;
     editorState.cursorPosition = getActualCursorCoordinates();
     
@@ -681,19 +836,14 @@ namespace UI {
       if (cindex == 0) {
         if (line > 0) {
           --line;
-          if (lines.size() > line) {
-            cindex = (int)lines[line].size();
-          } else {
-            cindex = 0;
-          }
+          cindex = (int)buffer.lineLength(line);
         }
       } else {
         --cindex;
         if (cindex > 0) {
-          if ((int)lines.size() > line) {
-            while (cindex > 0 && isUTF8Sequence(lines[line][cindex].m_char)) {
-              --cindex;
-            }
+          auto text = buffer.line(line);
+          while (cindex > 0 && isUTF8Sequence(text[cindex])) {
+            --cindex;
           }
         }
       }
@@ -732,15 +882,15 @@ namespace UI {
     PROFILE_START;
     Coordinate at = from;
     
-    if (at.line >= (int)lines.size()) {
+    if (at.line >= buffer.lineCount()) {
       return at;
     }
     
     auto cindex = getCharacterIndex(at);
-    auto& line = lines[at.line];
+    auto line = buffer.line(at.line);
     bool moved = false;
     
-    while (cindex < (int)line.size() && isspace(line[cindex].m_char)) {
+    while (cindex < (int)line.size() && isspace((uint8_t)line[cindex])) {
       cindex++;
       moved = true;
     }
@@ -751,7 +901,7 @@ namespace UI {
     
     moved = false;
     
-    while (cindex < (int)line.size() && !isANWord(line[cindex].m_char)) {
+    while (cindex < (int)line.size() && !isANWord(line[cindex])) {
       cindex++;
       moved = true;
     }
@@ -765,9 +915,9 @@ namespace UI {
         return {at.line, getCharacterColumn(at.line, cindex)};
       }
       
-      if (isANWord(line[cindex].m_char)) {
+      if (isANWord(line[cindex])) {
         cindex++;
-      } else if (isspace(line[cindex].m_char)) {
+      } else if (isspace((uint8_t)line[cindex])) {
         cindex++;
         break;
       } else {
@@ -782,7 +932,7 @@ namespace UI {
     PROFILE_START;
     auto oldPos = editorState.cursorPosition;
     
-    if (lines.empty() || oldPos.line >= lines.size()) {
+    if (oldPos.line >= buffer.lineCount()) {
       return;
     }
     
@@ -790,12 +940,12 @@ namespace UI {
     
     while (amount-- > 0) {
       auto lineIndex = editorState.cursorPosition.line;
-      auto& line = lines[lineIndex];
+      auto line = buffer.line(lineIndex);
       
       if (cindex >= line.size()) {
-        if (editorState.cursorPosition.line < lines.size() - 1) {
+        if (editorState.cursorPosition.line < buffer.lineCount() - 1) {
           editorState.cursorPosition.line =
-            std::max(0, std::min((int)lines.size() - 1,
+            std::max(0, std::min(buffer.lineCount() - 1,
                                  editorState.cursorPosition.line + 1));
           editorState.cursorPosition.column = 0;
         } else {
@@ -806,7 +956,7 @@ namespace UI {
           editorState.cursorPosition =
             findNextWord(editorState.cursorPosition);
         } else {
-          cindex += UTF8CharLength(line[cindex].m_char);
+          cindex += UTF8CharLength(line[cindex]);
           editorState.cursorPosition =
             Coordinate(lineIndex, getCharacterColumn(lineIndex, cindex));
         }
@@ -832,14 +982,9 @@ namespace UI {
   
   void EditorUI::moveEnd(bool shift) {
     PROFILE_START;
-    if (lines.empty()) {
-      return;
-    }
-    
     int lineNo = editorState.cursorPosition.line;
-    auto& line = lines[lineNo];
     
-    if(line.empty()) {
+    if(buffer.lineLength(lineNo) == 0) {
       return;
     }
     
@@ -865,17 +1010,11 @@ namespace UI {
   
   void EditorUI::moveHome(bool shift) {
     PROFILE_START;
-    if (lines.empty()) {
-      return;
-    }
-    
     int lineNo = editorState.cursorPosition.line;
     
     int oldCindex = getCharacterIndex(editorState.cursorPosition);
     
-    auto& line = lines[lineNo];
-    
-    if(line.empty()) {
+    if(buffer.lineLength(lineNo) == 0) {
       return;
     }
     auto old = editorState.cursorPosition;
@@ -902,10 +1041,6 @@ namespace UI {
   
   void EditorUI::moveTop(bool shift) {
     PROFILE_START;
-    if (lines.empty()) {
-      return;
-    }
-    
     auto old = editorState.cursorPosition;
     editorState.cursorPosition = Coordinate(0, 0);
     
@@ -924,12 +1059,8 @@ namespace UI {
   
   void EditorUI::moveBottom(bool shift) {
     PROFILE_START;
-    if (lines.empty()) {
-      return;
-    }
-    
     auto old = editorState.cursorPosition;
-    editorState.cursorPosition = Coordinate((int)lines.size() - 1, 0);
+    editorState.cursorPosition = Coordinate(buffer.lineCount() - 1, 0);
     
     if(shift) {
       if (hasSelection()) {
@@ -961,49 +1092,54 @@ namespace UI {
   void EditorUI::copy() {
     if(hasSelection()) {
       ImGui::SetClipboardText(getSelectedText().c_str());
-    } else if(!lines.empty()) {
-      std::string result;
-      auto& line = lines[getActualCursorCoordinates().line];
-      for (auto &g : line) {
-        result.push_back(g.m_char);
-      }
+    } else {
+      auto line = buffer.line(getActualCursorCoordinates().line);
+      std::string result(line);
       ImGui::SetClipboardText(result.c_str());
     }
   }
   
-  inline EditorUI::Line &EditorUI::insertLine(int index) {
-    return *lines.insert(lines.begin() + index, Line());
+  inline void EditorUI::insertLine(int index) {
+    if (index < buffer.lineCount()) {
+      insertBytes(buffer.lineStart(index), "\n", 1);
+    } else {
+      insertBytes(buffer.size(), "\n", 1);
+    }
+    textChanged = true;
   }
   
   int EditorUI::insertTextAt(Coordinate &pos, const char *value) {
     PROFILE_START;
-    int cindex = getCharacterIndex(pos);
+    std::string text;
+    text.reserve(strlen(value));
+    for (auto p = value; *p != '\0'; p++) {
+      if (*p != '\r') {
+        text.push_back(*p);
+      }
+    }
+    
+    if (text.empty()) {
+      return 0;
+    }
+    
+    auto cindex = getCharacterIndex(pos);
+    insertBytes(buffer.lineStart(pos.line) + cindex, text.data(), text.size());
+    textChanged = true;
+    
     int totalLines = 0;
-    while (*value != '\0') {
-      if (*value == '\r') {
-        ++value;
-      } else if (*value == '\n') {
-        if (cindex < (int)lines[pos.line].size()) {
-          auto& newLine = insertLine(pos.line + 1);
-          auto& line = lines[pos.line];
-          newLine.insert(newLine.begin(), line.end() + cindex, line.end());
-          line.erase(line.begin() + cindex, line.end());
-        } else {
-          insertLine(pos.line + 1);
-        }
-        pos.line++;
-        pos.column = 0;
+    auto lastLineStart = 0u;
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '\n') {
         ++totalLines;
-        ++value;
-      } else {
-        auto& line = lines[pos.line];
-        auto d = UTF8CharLength(*value);
-        while (d-- > 0 && *value != '\0') {
-          line.insert(line.begin() + cindex++, Glypth(*value++));
-        }
-        pos.column++;
+        lastLineStart = i + 1;
       }
-      textChanged = true;
+    }
+    
+    if (totalLines == 0) {
+      pos.column = getCharacterColumn(pos.line, cindex + (int)text.size());
+    } else {
+      pos.line += totalLines;
+      pos.column = getCharacterColumn(pos.line, (int)(text.size() - lastLineStart));
     }
     return totalLines;
   }
@@ -1048,23 +1184,22 @@ namespace UI {
       deleteSelection();
     } else {
       int lineNo = editorState.cursorPosition.line;
-      bool lastLine = lineNo == (int)lines.size() - 1;
-      deleteLine(lineNo, lineNo + 1);
+      bool lastLine = lineNo == buffer.lineCount() - 1;
       if (lastLine) {
-        insertLine(lineNo);
+        auto start = buffer.lineStart(lineNo);
+        eraseBytes(start, buffer.size() - start);
+        textChanged = true;
         editorState.cursorPosition = Coordinate(lineNo, 0);
+      } else {
+        deleteLine(lineNo, lineNo + 1);
       }
     }
   }
   
   void EditorUI::selectAll() {
     PROFILE_START;
-    if (lines.size() == 0) {
-      return;
-    }
-    
     interactiveStart = Coordinate(0, 0);
-    int lastLineNo = lines.size() - 1;
+    int lastLineNo = buffer.lineCount() - 1;
     Coordinate end = Coordinate(lastLineNo, getLineMaxColumn(lastLineNo));
     interactiveEnd = editorState.cursorPosition = end;
     
@@ -1087,29 +1222,34 @@ namespace UI {
         if (end.column == 0 && end.line > 0) {
           --end.line;
         }
-        if (end.line >= (int)lines.size()) {
-          end.line = lines.empty() ? 0 : (int)lines.size() - 1;
+        if (end.line >= buffer.lineCount()) {
+          end.line = buffer.lineCount() - 1;
         }
         end.column = getLineMaxColumn(end.line);
         
         bool modified = false;
         
         for (int i = start.line; i <= end.line; i++) {
-          auto& line = lines[i];
+          auto lineStart = buffer.lineStart(i);
+          auto line = buffer.line(i);
           if (shift) {
             if (!line.empty()) {
-              if (line.front().m_char == '\t') {
-                line.erase(line.begin());
+              if (line.front() == '\t') {
+                eraseBytes(lineStart, 1);
                 modified = true;
               } else {
-                for (int j = 0; j < tabSize && !line.empty() && line.front().m_char == ' '; j++) {
-                  line.erase(line.begin());
+                size_t spaces = 0;
+                while (spaces < (size_t)tabSize && spaces < line.size() && line[spaces] == ' ') {
+                  spaces++;
+                }
+                if (spaces > 0) {
+                  eraseBytes(lineStart, spaces);
                   modified = true;
                 }
               }
             }
           } else {
-            line.insert(line.begin(), Glypth('\t'));
+            insertBytes(lineStart, "\t", 1);
             modified = true;
           }
         }
@@ -1136,16 +1276,10 @@ namespace UI {
     auto coord = getActualCursorCoordinates();
     
     if (c == '\n') {
-      insertLine(coord.line + 1);
-      auto &line = lines[coord.line];
-      auto &newLine = lines[coord.line + 1];
-      
       // TODO(Maxlisui): Auto Indentation
       
-      const size_t whiteSpaceSize = newLine.size();
-      auto cindex = getCharacterIndex(coord);
-      newLine.insert(newLine.begin(), line.begin() + cindex, line.end());
-      line.erase(line.begin() + cindex, line.begin() + line.size());
+      const size_t whiteSpaceSize = 0;
+      insertBytes(getOffset(coord), "\n", 1);
       setCursorPosition(Coordinate(coord.line + 1, getCharacterColumn(coord.line + 1, (int)whiteSpaceSize)));
     } else {
       char buf[7];
@@ -1156,20 +1290,17 @@ namespace UI {
       }
       
       buf[e] = '\0';
-      auto &line = lines[coord.line];
+      auto line = buffer.line(coord.line);
+      auto lineStart = buffer.lineStart(coord.line);
       auto cindex = getCharacterIndex(coord);
       
       if (override && cindex < (int)line.size()) {
-        auto d = UTF8CharLength(line[cindex].m_char);
-        
-        while (d-- > 0 && cindex < (int)line.size()) {
-          line.erase(line.begin() + cindex);
-        }
+        auto d = std::min(UTF8CharLength(line[cindex]), (int)line.size() - cindex);
+        eraseBytes(lineStart + cindex, d);
       }
       
-      for (auto p = buf; *p != '\0'; p++, cindex++) {
-        line.insert(line.begin() + cindex, Glypth(*p));
-      }
+      insertBytes(lineStart + cindex, buf, e);
+      cindex += e;
       
       setCursorPosition(Coordinate(coord.line, getCharacterColumn(coord.line, cindex)));
     }
@@ -1179,10 +1310,6 @@ namespace UI {
   }
   
   void EditorUI::backspace() {
-    if (lines.empty()) {
-      return;
-    }
-    
     if (hasSelection()) {
       deleteSelection();
     } else {
@@ -1195,28 +1322,24 @@ namespace UI {
         }
         
         int lineNo = editorState.cursorPosition.line;
-        auto& line = lines[lineNo];
-        auto& prevLine = lines[lineNo];
         auto prevSize = getLineMaxColumn(lineNo - 1);
         
-        prevLine.insert(prevLine.end(), line.begin(), line.end());
+        // Joining with the previous line only removes its line feed.
+        eraseBytes(buffer.lineStart(lineNo) - 1, 1);
         
-        deleteLine(lineNo);
         --editorState.cursorPosition.line;
         editorState.cursorPosition.column = prevSize;
       } else {
-        auto& line = lines[editorState.cursorPosition.line];
-        auto cindex = getCharacterIndex(pos) - 1;
-        auto cend = cindex + 1;
-        while (cindex > 0 && isUTF8Sequence(line[cindex].m_char)) {
+        auto lineNo = editorState.cursorPosition.line;
+        auto line = buffer.line(lineNo);
+        auto cend = getCharacterIndex(pos);
+        auto cindex = cend - 1;
+        while (cindex > 0 && isUTF8Sequence(line[cindex])) {
           cindex--;
         }
         
-        --editorState.cursorPosition.column;
-        
-        while (cindex < line.size() && cend-- > cindex) {
-          line.erase(line.begin() + cindex);
-        }
+        eraseBytes(buffer.lineStart(lineNo) + cindex, cend - cindex);
+        editorState.cursorPosition.column = getCharacterColumn(lineNo, cindex);
       }
       
       textChanged = true;
@@ -1225,32 +1348,25 @@ namespace UI {
   }
   
   void EditorUI::remove() {
-    if (lines.empty()) {
-      return;
-    }
-    
     if (hasSelection()) {
       deleteSelection();
     }
     
     auto pos = getActualCursorCoordinates();
     setCursorPosition(pos);
-    auto& line = lines[pos.line];
+    auto line = buffer.line(pos.line);
+    auto lineStart = buffer.lineStart(pos.line);
     
     if (pos.column == getLineMaxColumn(pos.line)) {
-      if (pos.line == (int)lines.size() - 1) {
+      if (pos.line == buffer.lineCount() - 1) {
         return;
       }
       
-      auto& nextLine = lines[pos.line + 1];
-      line.insert(line.end(), nextLine.begin(), nextLine.end());
-      deleteLine(pos.line + 1);
+      eraseBytes(lineStart + line.size(), 1);
     } else {
       auto cindex = getCharacterIndex(pos);
-      auto d = UTF8CharLength(line[cindex].m_char);
-      while (d-- > 0 && cindex < (int)line.size()) {
-        line.erase(line.begin() + cindex);
-      }
+      auto d = std::min(UTF8CharLength(line[cindex]), (int)line.size() - cindex);
+      eraseBytes(lineStart + cindex, d);
     }
     
     textChanged = true;
@@ -1262,9 +1378,7 @@ namespace UI {
       return;
     }
     
-    if (!searchResults.empty()) {
-      searchResults.clear();
-    }
+    clearSearch();
   }
   
   void EditorUI::save() {
@@ -1274,11 +1388,12 @@ namespace UI {
       return;
     }
     
-    int lastLineNo = lines.size() - 1;
-    Coordinate end = Coordinate(lastLineNo, getLineMaxColumn(lastLineNo));
-    string text = getText(Coordinate(0, 0), end);
+    // The saved text becomes the original, the edits made so far are done
+    // with.
+    auto text = std::make_shared<const string>(buffer.getText(0, buffer.size()));
+    buffer.rebase(text, text->data(), text->size());
     
-    onSave(text);
+    onSave(*text);
     textChanged = false;
   }
   
@@ -1378,15 +1493,13 @@ namespace UI {
     handleKeyboardInput();
     handleMouseInput();
     
+    pollSearch();
     searchAndReplace->render(showSearchAndReplace);
     
-    const float fontSize = ImGui::GetFont()
-      ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX,
-                      -1.f, "#", nullptr, nullptr)
-      .x;
+    auto &glyphs = getGlyphCache();
     
     charAdvance =
-      ImVec2(fontSize, ImGui::GetTextLineHeightWithSpacing() * lineSpacing);
+      ImVec2(glyphs.advance("#", 1), ImGui::GetTextLineHeightWithSpacing() * lineSpacing);
     
     auto contentSize = ImGui::GetWindowContentRegionMax();
     auto drawList = ImGui::GetWindowDrawList();
@@ -1394,23 +1507,16 @@ namespace UI {
     ImVec2 cursorScreenPos = ImGui::GetCursorScreenPos();
     auto scrollX = ImGui::GetScrollX();
     auto scrollY = ImGui::GetScrollY();
-    float longest = textStartPixel;
-    
-    lineBuffer.clear();
+    float longest = textStartPixel + getLongestLineWidth();
     
     auto lineNo = (int)floor(scrollY / charAdvance.y);
     
     auto lineMax = std::max(
                             0, std::min(
-                                        (int)lines.size(),
+                                        buffer.lineCount(),
                                         lineNo + (int)floor((scrollY + contentSize.y) / charAdvance.y)));
     
-    if (!lines.empty()) {
-      float spaceSize = ImGui::GetFont()
-        ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f,
-                        " ", nullptr, nullptr)
-        .x;
-      
+    {
       char buf[16];
       
       while (lineNo < lineMax) {
@@ -1419,14 +1525,6 @@ namespace UI {
         auto textScreenPos =
           ImVec2(lineStartScreenPos.x + textStartPixel, lineStartScreenPos.y);
         
-        auto& line = lines[lineNo];
-        
-        auto lineMaxColumn = getLineMaxColumn(lineNo);
-        
-        longest = std::max(textStartPixel + textDistanceToLineStart(Coordinate(
-                                                                               lineNo, lineMaxColumn)),
-                           longest);
-        
         Coordinate lineStartCoord = Coordinate(lineNo, 0);
         Coordinate lineEndCoord = Coordinate(lineNo, getLineMaxColumn(lineNo));
         
@@ -1443,11 +1541,15 @@ namespace UI {
           drawList->AddRectFilled(vstart, vend, 0x80a06020);
         }
         
-        for(auto &result : searchResults) {
+        int firstResult, lastResult;
+        getSearchResultsOnLine(lineNo, firstResult, lastResult);
+        for (int r = firstResult; r < lastResult; r++) {
+          auto resultStart = getCoordinate(searchResults[r]);
+          auto resultEnd = getCoordinate(searchResultEnd(r));
           float srStart = -1.f;
           float srEnd = -1.f;
           
-          createUIRange(result.start, result.end, lineStartCoord, lineEndCoord, srStart, srEnd, lineNo);
+          createUIRange(resultStart, resultEnd, lineStartCoord, lineEndCoord, srStart, srEnd, lineNo);
           
           if (srStart != -1 && srEnd != -1 && srStart < srEnd) {
             ImVec2 vstart(lineStartScreenPos.x + textStartPixel + srStart,
@@ -1494,22 +1596,10 @@ namespace UI {
               auto cindex = getCharacterIndex(editorState.cursorPosition);
               float cx = textDistanceToLineStart(editorState.cursorPosition);
               
+              auto line = getLineText(lineNo);
               if (override && cindex < (int)line.size()) {
-                auto c = line[cindex].m_char;
-                if (c == '\t') {
-                  auto x = (1.0f + std::floor((1.0f + cx) /
-                                              (float(tabSize) * spaceSize))) *
-                    (float(tabSize) * spaceSize);
-                  width = x - cx;
-                } else {
-                  char buf2[2];
-                  buf2[0] = line[cindex].m_char;
-                  buf2[1] = '\0';
-                  width = ImGui::GetFont()
-                    ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX,
-                                    -1.0f, buf2)
-                    .x;
-                }
+                auto d = std::min(UTF8CharLength(line[cindex]), (int)line.size() - cindex);
+                width = getLineOffsets(lineNo)[cindex + d] - cx;
               }
               
               ImVec2 cstart(textScreenPos.x + cx, lineStartScreenPos.y);
@@ -1529,19 +1619,12 @@ namespace UI {
         ImVec2 bufferOffset;
         
         // Render Text
-        for (int i = 0; i < line.size();) {
-          auto& glyph = line[i];
-          auto l = UTF8CharLength(glyph.m_char);
-          while (l-- > 0) {
-            lineBuffer.push_back(line[i++].m_char);
-          }
-        }
+        auto line = getLineText(lineNo);
         
-        if (!lineBuffer.empty()) {
+        if (!line.empty()) {
           const ImVec2 newOffset(textScreenPos.x + bufferOffset.x,
                                  textScreenPos.y + bufferOffset.y);
-          drawList->AddText(newOffset, 0xffffffff, lineBuffer.c_str());
-          lineBuffer.clear();
+          drawList->AddText(newOffset, 0xffffffff, line.data(), line.data() + line.size());
         }
         
         lineNo++;
@@ -1588,89 +1671,383 @@ namespace UI {
       
     }
     ImGui::Dummy(ImVec2((longest + 2),
-                        (lines.size() * charAdvance.y) + bottomLineHeight));
+                        (buffer.lineCount() * charAdvance.y) + bottomLineHeight));
   }
   
-  void EditorUI::setFindResult(const string& str) {
-    for (int i = 0; i < lines.size(); i++) {
-      string currentLine;
-      for (auto &glypth : lines[i]) {
-        currentLine += glypth.m_char;
+  bool EditorUI::searchMatchCase() const {
+    return !searchAndReplace || searchAndReplace->matchCase;
+  }
+  
+  bool EditorUI::searchRegex() const {
+    return searchAndReplace && searchAndReplace->useRegex;
+  }
+  
+  bool EditorUI::isSearchStale(const string& str) const {
+    return str != lastSearchString || searchMatchCase() != lastSearchMatchCase ||
+      searchRegex() != lastSearchRegex;
+  }
+  
+  void EditorUI::resetSearch(const string& str) {
+    searchJob.reset();
+    searchRestartTime = -1.0;
+    searchResults.clear();
+    searchResultEnds.clear();
+    currentSearchItem = -1;
+    searchWrapCount = 0;
+    searchJump = 0;
+    lastSearchString = str;
+    lastSearchMatchCase = searchMatchCase();
+    lastSearchRegex = searchRegex();
+    searchLength = str.size();
+    if (searchAndReplace) {
+      searchAndReplace->searchError.clear();
+    }
+  }
+  
+  void EditorUI::clearSearch() {
+    resetSearch("");
+    updateSearchStatus();
+  }
+  
+  void EditorUI::updateSearchStatus() {
+    if (!searchAndReplace) {
+      return;
+    }
+    searchAndReplace->searching = searchJob != nullptr || searchRestartTime >= 0.0;
+    searchAndReplace->matchCount = lastSearchString.empty() ? -1 : (int)searchResults.size();
+  }
+  
+  bool EditorUI::reuseSearch(const string& str) {
+    PROFILE_START;
+    const CachedSearch *prefix = nullptr;
+    for (auto& cached : searchCache) {
+      if (cached.matchCase != lastSearchMatchCase) {
+        continue;
       }
       
-      auto pos = currentLine.find(str, 0);
-      while (pos != string::npos) {
-        SelectionRange range;
-        range.start = Coordinate(i, (int)pos);
-        range.end = Coordinate(i, (int)(pos + str.size()));
-        searchResults.emplace_back(range);
-        
-        pos = currentLine.find(str, pos + 1);
+      if (cached.text == str) {
+        searchResults = cached.hits;
+        return true;
+      }
+      
+      // Every match of the longer query is also a match of the shorter one,
+      // as long as the shorter one never overlaps itself.
+      if (cached.text.size() < str.size() && str.compare(0, cached.text.size(), cached.text) == 0 &&
+          (!prefix || cached.text.size() > prefix->text.size()) &&
+          !Text::Searcher(cached.text, cached.matchCase).selfOverlaps()) {
+        prefix = &cached;
       }
     }
     
-    if (!searchResults.empty()) {
-      editorState.cursorPosition = searchResults[0].start;
-      ensureCursorVisible();
+    if (!prefix) {
+      return false;
     }
+    
+    Text::Searcher searcher(str, lastSearchMatchCase);
+    std::vector<std::string_view> spans;
+    buffer.spans(spans);
+    searcher.refine(spans, prefix->hits, searchResults);
+    return true;
   }
   
-  void EditorUI::findNext(const string& next) {
-    if (lines.empty()) {
+  void EditorUI::rememberSearch() {
+    if (lastSearchString.empty() || lastSearchRegex) {
       return;
     }
     
-    if (next != lastSearchString) {
-      lastSearchString = next;
-      searchResults.clear();
+    auto existing = std::find_if(searchCache.begin(), searchCache.end(), [&](const CachedSearch& cached) {
+      return cached.text == lastSearchString && cached.matchCase == lastSearchMatchCase;
+    });
+    if (existing != searchCache.end()) {
+      searchCache.erase(existing);
     }
     
-    if (searchResults.empty()) {
-      setFindResult(next);
-    } else {
-      currentSearchItem++;
-      if (currentSearchItem == (int)searchResults.size()) {
-        currentSearchItem = 0;
+    searchCache.push_back({lastSearchString, lastSearchMatchCase, searchResults});
+    if (searchCache.size() > SearchCacheSize) {
+      searchCache.erase(searchCache.begin());
+    }
+  }
+  
+  void EditorUI::setFindResult(const string& str) {
+    PROFILE_START;
+    resetSearch(str);
+    
+    if (!str.empty() && !reuseSearch(str)) {
+      Text::Searcher searcher(str, lastSearchMatchCase);
+      std::vector<std::string_view> spans;
+      buffer.spans(spans);
+      searcher.findAll(spans, searchResults);
+    }
+    
+    rememberSearch();
+    updateSearchStatus();
+  }
+  
+  void EditorUI::startSearch(const string& str, int jump) {
+    PROFILE_START;
+    resetSearch(str);
+    
+    if (str.empty()) {
+      updateSearchStatus();
+      return;
+    }
+    
+    // Compiled here so a bad pattern is reported right away, the matching
+    // runs in the background like any other search.
+    if (lastSearchRegex) {
+      Text::Regex regex;
+      if (compileSearchRegex(str, regex)) {
+        searchLength = 0;
+        searchJump = jump;
+        searchJob = std::make_unique<Text::SearchJob>(buffer.snapshot(), std::move(regex),
+                                                      getOffset(editorState.cursorPosition));
       }
-      
-      editorState.cursorPosition = searchResults[currentSearchItem].start;
-      ensureCursorVisible();
+      updateSearchStatus();
+      return;
     }
+    
+    if (reuseSearch(str)) {
+      rememberSearch();
+      updateSearchStatus();
+      if (jump != 0 && !searchResults.empty()) {
+        jumpToNearestSearchResult(jump > 0);
+      }
+      return;
+    }
+    
+    searchJump = jump;
+    searchJob = std::make_unique<Text::SearchJob>(buffer.snapshot(), str, lastSearchMatchCase,
+                                                  getOffset(editorState.cursorPosition));
+    updateSearchStatus();
   }
   
-  void EditorUI::findPrev(const string& prev) {
-    if (lines.empty()) {
+  bool EditorUI::compileSearchRegex(const string& str, Text::Regex& regex) {
+    string error;
+    if (regex.compile(str, lastSearchMatchCase, error)) {
+      return true;
+    }
+    
+    if (searchAndReplace) {
+      searchAndReplace->searchError = error;
+    }
+    return false;
+  }
+  
+  std::string_view EditorUI::searchedText(string& storage) const {
+    std::vector<std::string_view> spans;
+    buffer.spans(spans);
+    if (spans.size() == 1) {
+      return spans[0];
+    }
+    
+    // Regex matches may cross pieces, so those get copied together.
+    storage = buffer.getText(0, buffer.size());
+    return storage;
+  }
+  
+  size_t EditorUI::searchResultEnd(int index) const {
+    return searchResultEnds.empty() ? searchResults[index] + searchLength : searchResultEnds[index];
+  }
+  
+  void EditorUI::searchAsYouType(const string& str) {
+    // Half typed patterns rarely compile, regex searches wait for Find Next.
+    if (searchRegex()) {
+      resetSearch("");
+      updateSearchStatus();
+      return;
+    }
+    
+    startSearch(str, 0);
+  }
+  
+  void EditorUI::pollSearch() {
+    if (searchRestartTime >= 0.0 && ImGui::GetTime() >= searchRestartTime) {
+      startSearch(lastSearchString, searchJump);
+    }
+    if (!searchJob) {
       return;
     }
     
-    if (prev != lastSearchString) {
-      lastSearchString = prev;
+    PROFILE_START;
+    // Checked before taking, so a finished job has nothing left behind.
+    auto finished = searchJob->finished();
+    std::vector<size_t> after, before, afterEnds, beforeEnds;
+    searchJob->take(after, before, afterEnds, beforeEnds);
+    
+    for (size_t i = 0; i < afterEnds.size(); i++) {
+      searchLength = std::max(searchLength, afterEnds[i] - after[i]);
+    }
+    for (size_t i = 0; i < beforeEnds.size(); i++) {
+      searchLength = std::max(searchLength, beforeEnds[i] - before[i]);
+    }
+    
+    searchResults.insert(searchResults.end(), after.begin(), after.end());
+    searchResultEnds.insert(searchResultEnds.end(), afterEnds.begin(), afterEnds.end());
+    if (!beforeEnds.empty()) {
+      searchResultEnds.insert(searchResultEnds.begin() + searchWrapCount, beforeEnds.begin(), beforeEnds.end());
+    }
+    if (!before.empty()) {
+      searchResults.insert(searchResults.begin() + searchWrapCount, before.begin(), before.end());
+      if (currentSearchItem >= searchWrapCount) {
+        currentSearchItem += (int)before.size();
+      }
+      searchWrapCount += (int)before.size();
+    }
+    
+    // The first match after the cursor is reported first, the search only
+    // wraps to the top when there is none.
+    if (searchJump > 0 && (int)searchResults.size() > searchWrapCount) {
+      jumpToSearchResult(searchWrapCount);
+    } else if (searchJump != 0 && finished && !searchResults.empty()) {
+      jumpToNearestSearchResult(searchJump > 0);
+    }
+    
+    if (finished) {
+      searchJob.reset();
+      rememberSearch();
+    }
+    updateSearchStatus();
+  }
+  
+  void EditorUI::shiftSearchResults(size_t offset, size_t removed, size_t added) {
+    PROFILE_START;
+    // Cached queries are not worth patching, the current one is.
+    searchCache.clear();
+    if (lastSearchString.empty()) {
+      return;
+    }
+    
+    // Offsets of a running search belong to the text it started on, and a
+    // regex match can depend on text far away from it. Those search again
+    // once the typing pauses, not with a new snapshot on every key.
+    if (searchJob || lastSearchRegex || searchRestartTime >= 0.0) {
+      searchJob.reset();
       searchResults.clear();
+      searchResultEnds.clear();
+      currentSearchItem = -1;
+      searchWrapCount = 0;
+      searchRestartTime = ImGui::GetTime() + SearchRestartDelay;
+      updateSearchStatus();
+      return;
     }
     
-    if (searchResults.empty()) {
-      setFindResult(prev);
+    auto m = searchLength;
+    auto from = offset - std::min(offset, m - 1);
+    
+    // Hits touching the edited bytes are gone, the ones after it only move.
+    auto first = std::lower_bound(searchResults.begin(), searchResults.end(), from);
+    auto last = std::lower_bound(first, searchResults.end(), offset + removed);
+    for (auto it = last; it != searchResults.end(); ++it) {
+      *it = *it - removed + added;
+    }
+    
+    auto index = (int)(first - searchResults.begin());
+    auto erased = (int)(last - first);
+    searchResults.erase(first, last);
+    
+    // New matches can only appear around the edit.
+    auto to = std::min(buffer.size(), offset + added + m - 1);
+    auto window = buffer.getText(from, to);
+    std::vector<size_t> hits;
+    Text::Searcher(lastSearchString, lastSearchMatchCase).findAll(window.data(), window.size(), hits);
+    
+    std::vector<size_t> found;
+    for (auto hit : hits) {
+      hit += from;
+      auto overlapsBefore = index > 0 && searchResults[index - 1] + m > hit;
+      auto overlapsAfter = index < (int)searchResults.size() && hit + m > searchResults[index];
+      if (hit < offset + added && hit + m > offset && !overlapsBefore && !overlapsAfter) {
+        found.push_back(hit);
+      }
+    }
+    searchResults.insert(searchResults.begin() + index, found.begin(), found.end());
+    
+    if (currentSearchItem >= index + erased) {
+      currentSearchItem += (int)found.size() - erased;
+    } else if (currentSearchItem >= index) {
+      currentSearchItem = -1;
+    }
+    updateSearchStatus();
+  }
+  
+  void EditorUI::getSearchResultsOnLine(int lineNo, int& first, int& last) const {
+    auto lineStart = buffer.lineStart(lineNo);
+    auto lineEnd = lineStart + buffer.lineLength(lineNo);
+    
+    // Hits are sorted, the ones reaching into the line start at most
+    // searchLength - 1 bytes before it.
+    auto begin = std::lower_bound(searchResults.begin(), searchResults.end(),
+                                  lineStart - std::min(lineStart, searchLength - 1));
+    auto end = std::upper_bound(begin, searchResults.end(), lineEnd);
+    
+    first = (int)(begin - searchResults.begin());
+    last = (int)(end - searchResults.begin());
+  }
+  
+  void EditorUI::jumpToSearchResult(int index) {
+    currentSearchItem = index;
+    searchJump = 0;
+    setCursorOffset(searchResults[index]);
+  }
+  
+  void EditorUI::jumpToNearestSearchResult(bool forward) {
+    auto at = getOffset(editorState.cursorPosition);
+    auto index = (int)(std::lower_bound(searchResults.begin(), searchResults.end(), at) - searchResults.begin());
+    auto count = (int)searchResults.size();
+    
+    if (forward) {
+      jumpToSearchResult(index < count ? index : 0);
+    } else {
+      jumpToSearchResult(index > 0 ? index - 1 : count - 1);
+    }
+  }
+  
+  void EditorUI::findNext(const string& next) {
+    if (isSearchStale(next) || (searchResults.empty() && !searchJob)) {
+      startSearch(next, 1);
+    } else if (searchResults.empty()) {
+      searchJump = 1;
+    } else if (currentSearchItem < 0) {
+      jumpToNearestSearchResult(true);
+    } else {
+      currentSearchItem++;
+      if (currentSearchItem >= (int)searchResults.size()) {
+        currentSearchItem = 0;
+      }
+      
+      jumpToSearchResult(currentSearchItem);
+    }
+  }
+  
+  void EditorUI::findPrev(const string& prev) {
+    if (isSearchStale(prev) || (searchResults.empty() && !searchJob)) {
+      startSearch(prev, -1);
+    } else if (searchResults.empty()) {
+      searchJump = -1;
+    } else if (currentSearchItem < 0) {
+      jumpToNearestSearchResult(false);
     } else {
       currentSearchItem--;
       if (currentSearchItem < 0) {
         currentSearchItem = (int)searchResults.size() - 1;
       }
       
-      editorState.cursorPosition = searchResults[currentSearchItem].start;
-      ensureCursorVisible();
+      jumpToSearchResult(currentSearchItem);
     }
   }
   
   void EditorUI::replaceAll(const string& searchText, const string& replaceText) {
-    if (lines.empty()) {
+    if (readOnly) {
       return;
     }
     
-    if (searchText != lastSearchString) {
-      searchResults.clear();
+    if (searchRegex()) {
+      replaceAllRegex(searchText, replaceText);
+      return;
     }
     
-    if (searchResults.empty()) {
+    // Replacing needs every match, not just the ones found so far.
+    if (isSearchStale(searchText) || searchJob || searchResults.empty()) {
       setFindResult(searchText);
     }
     
@@ -1678,16 +2055,69 @@ namespace UI {
       return;
     }
     
-    auto cursorBefore = editorState.cursorPosition;
+    std::vector<size_t> ranges;
+    ranges.reserve(searchResults.size() * 2);
+    for (auto hit : searchResults) {
+      ranges.push_back(hit);
+      ranges.push_back(hit + searchLength);
+    }
+    clearSearch();
     
-    for(auto &result : searchResults) {
-      deleteRange(result.start, result.end);
-      setCursorPosition(result.start);
-      insertText(replaceText);
+    std::vector<std::string_view> replacements(ranges.size() / 2, replaceText);
+    replaceRanges(ranges, replacements);
+  }
+  
+  void EditorUI::replaceAllRegex(const string& searchText, const string& replaceText) {
+    PROFILE_START;
+    clearSearch();
+    
+    Text::Replacer replacer;
+    string error;
+    if (!replacer.compile(searchText, replaceText, lastSearchMatchCase, true, error)) {
+      if (searchAndReplace && !searchText.empty()) {
+        searchAndReplace->searchError = error;
+      }
+      return;
     }
     
-    editorState.cursorPosition = cursorBefore;
-    searchResults.clear();
+    replaceMatches(replacer);
+  }
+  
+  size_t EditorUI::replaceMatches(const Text::Replacer& replacer) {
+    PROFILE_START;
+    if (readOnly) {
+      return 0;
+    }
+    
+    string storage, expanded;
+    std::vector<size_t> ranges;
+    std::vector<std::string_view> replacements;
+    auto count = replacer.collect(searchedText(storage), ranges, replacements, expanded);
+    if (count > 0) {
+      clearSearch();
+      replaceRanges(ranges, replacements);
+    }
+    return count;
+  }
+  
+  void EditorUI::replaceRanges(const std::vector<size_t>& ranges, const std::vector<std::string_view>& replacements) {
+    PROFILE_START;
+    if (replacements.empty()) {
+      return;
+    }
+    
+    auto cursorBefore = editorState.cursorPosition;
+    
+    // One rebuild of the whole text rather than an edit per match, every
+    // line is laid out again anyway.
+    buffer.replace(ranges, replacements);
+    lineLayouts.clear();
+    lineWidths.clear();
+    // Nothing goes through shiftSearchResults here, which would drop these.
+    searchCache.clear();
+    textChanged = true;
+    
+    editorState.cursorPosition = sanitizeCoordinates(cursorBefore);
   }
   
   void EditorUI::setSearchAndReplace(SearchAndReplaceUI *search) {
@@ -1696,5 +2126,6 @@ namespace UI {
     search->onFindNext = [this](const string& next) { this->findNext(next); };
     search->onFindPrev = [this](const string& prev) { this->findPrev(prev); };
     search->onReplaceAll = [this](const string& search, const string& replace) { this->replaceAll(search, replace); };
+    search->onSearchChanged = [this](const string& text) { this->searchAsYouType(text); };
   }
 }  // namespace UI
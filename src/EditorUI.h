@@ -1,11 +1,18 @@
 #pragma once
 
 #include "Constants.h"
+#include "GlyphCache.h"
 #include "../vendor/imgui/imgui.h"
+#include "Regex.h"
 #include "SearchAndReplaceUI.h"
+#include "SearchJob.h"
+#include "TextBuffer.h"
+#include "TextReplace.h"
 #include <chrono>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <set>
 
 namespace UI {
   struct EditorUI {
@@ -23,14 +30,9 @@ namespace UI {
     selectionMode(SelectionMode::Normal),
     searchAndReplace(nullptr),
     showSearchAndReplace(false),
-    currentSearchItem(0),
+    currentSearchItem(-1),
     lastSearchString("") {}
     
-    struct Glypth {
-      Glypth(uint8_t character) : m_char(character) {}
-      uint8_t m_char;
-    };
-    
     struct Coordinate {
       Coordinate() : column(0), line(0) {}
       Coordinate(int line, int column) : line(line), column(column) {}
@@ -77,22 +79,45 @@ namespace UI {
       Coordinate cursorPosition;
     };
     
-    struct SelectionRange {
-      Coordinate start;
-      Coordinate end;
-    };
-    
     enum class SelectionMode { Normal, Word, Line };
     
-    typedef std::vector<Glypth> Line;
-    typedef std::vector<Line> Lines;
+    // Column <-> byte mapping of a single line, built on first use and
+    // dropped whenever the line is edited. Pure ASCII lines without tabs
+    // map columns to bytes one to one and skip the tables. Lines that are
+    // not stored contiguously in the buffer keep a joined copy of their
+    // text. Pixel offsets are built separately on first draw and stamped
+    // with the glyph cache generation they were measured with.
+    struct LineLayout {
+      bool simple;
+      int size;
+      int maxColumn;
+      bool joined = false;
+      string text;
+      std::vector<int> columnToIndex;
+      std::vector<int> indexToColumn;
+      uint32_t offsetsGeneration = 0;
+      std::vector<float> offsets;
+    };
     
     void setText(const string &text);
+    void setText(const char *data, size_t size);
     void render();
     void setSearchAndReplace(SearchAndReplaceUI *search);
     float textDistanceToLineStart(const EditorUI::Coordinate &from) const;
+    GlyphCache &getGlyphCache() const;
     int getCharacterIndex(const EditorUI::Coordinate &from) const;
+    size_t getOffset(const EditorUI::Coordinate &from) const;
+    Coordinate getCoordinate(size_t offset) const;
     int getLineMaxColumn(int line) const;
+    const LineLayout &getLineLayout(int line) const;
+    std::string_view getLineText(int line) const;
+    const std::vector<float> &getLineOffsets(int line) const;
+    void invalidateLines(int first, int removed, int added);
+    float measureLineWidth(int line) const;
+    float getLongestLineWidth();
+    void updateLineWidths(int first, int removed, int added);
+    void insertBytes(size_t offset, const char *text, size_t length);
+    void eraseBytes(size_t offset, size_t length);
     int getPageSize() const;
     bool hasSelection() const;
     void handleMouseInput();
@@ -101,6 +126,9 @@ namespace UI {
     void setSelection(const Coordinate &start, const Coordinate &end,
                       SelectionMode mode);
     void setCursorPosition(const Coordinate& pos);
+    void setCursorOffset(size_t offset);
+    // Zero based line and byte column, as search results give them.
+    void setCursorLine(int line, size_t byteColumn);
     void handleKeyboardInput();
     void deleteSelection();
     void deleteRange(const Coordinate& from, const Coordinate& to);
@@ -134,19 +162,46 @@ namespace UI {
     void insertText(const std::string& value);
     void insertText(const char *value);
     int insertTextAt(Coordinate &pos, const char *value);
-    Line &insertLine(int index);
+    void insertLine(int index);
     void insertCharacter(ImWchar c, bool shift);
+    bool searchMatchCase() const;
+    bool searchRegex() const;
+    bool isSearchStale(const string& str) const;
+    void resetSearch(const string& str);
+    void clearSearch();
+    void updateSearchStatus();
+    bool reuseSearch(const string& str);
+    void rememberSearch();
     void setFindResult(const string& str);
+    void startSearch(const string& str, int jump);
+    bool compileSearchRegex(const string& str, Text::Regex& regex);
+    std::string_view searchedText(string& storage) const;
+    size_t searchResultEnd(int index) const;
+    void searchAsYouType(const string& str);
+    void pollSearch();
+    void shiftSearchResults(size_t offset, size_t removed, size_t added);
+    void getSearchResultsOnLine(int line, int &first, int &last) const;
+    void jumpToSearchResult(int index);
+    void jumpToNearestSearchResult(bool forward);
     void findNext(const string& next);
     void findPrev(const string& prev);
     void replaceAll(const string& searchText, const string& replaceText);
+    void replaceAllRegex(const string& searchText, const string& replaceText);
+    // Replaces every match in the whole text, returns how many there were.
+    size_t replaceMatches(const Text::Replacer& replacer);
+    void replaceRanges(const std::vector<size_t>& ranges, const std::vector<std::string_view>& replacements);
     void save();
     
-    Lines lines;
+    Text::TextBuffer buffer;
+    mutable std::vector<std::unique_ptr<LineLayout>> lineLayouts;
+    // Pixel width of every line, measured on the first frame after a load
+    // or font change and patched on edit. The set answers the widest one.
+    std::vector<float> lineWidths;
+    std::multiset<float> lineWidthSet;
+    uint32_t lineWidthsGeneration = 0;
     float lineSpacing;
     float textStartPixel;
     int tabSize;
-    string lineBuffer;
     EditorState editorState;
     uint64_t startTime;
     Coordinate interactiveStart;
@@ -154,15 +209,44 @@ namespace UI {
     bool override;
     float lastClick;
     ImVec2 charAdvance;
+    mutable GlyphCache glyphCache;
     SelectionMode selectionMode;
     bool cursoPositionChanged;
     bool readOnly;
     bool textChanged;
     SearchAndReplaceUI *searchAndReplace;
     bool showSearchAndReplace;
-    std::vector<SelectionRange> searchResults;
+    // Byte offsets of the matches in document order, all searchLength bytes
+    // long. Edits shift them instead of throwing them away.
+    std::vector<size_t> searchResults;
+    size_t searchLength = 0;
+    // Regex matches vary in length, their ends go here and searchLength is
+    // the longest one. Edits search again, there is no window to rescan.
+    std::vector<size_t> searchResultEnds;
+    // -1 until Find Next or Find Previous picked a result.
     int currentSearchItem;
     string lastSearchString;
+    bool lastSearchMatchCase = true;
+    bool lastSearchRegex = false;
+    // Running background search. Results from the cursor onwards are
+    // appended, the ones in front of it go before them at searchWrapCount.
+    // searchJump is the direction to jump in once results arrive.
+    std::unique_ptr<Text::SearchJob> searchJob;
+    int searchWrapCount = 0;
+    int searchJump = 0;
+    // When a search cut short by an edit starts over, -1 for none. Every
+    // further edit pushes it back by SearchRestartDelay seconds.
+    static constexpr double SearchRestartDelay = 0.3;
+    double searchRestartTime = -1.0;
+    // Complete results of recent queries, dropped on every edit. A shorter
+    // query reuses its old hits, a longer one filters a prefix's hits.
+    struct CachedSearch {
+      string text;
+      bool matchCase;
+      std::vector<size_t> hits;
+    };
+    static constexpr size_t SearchCacheSize = 8;
+    std::vector<CachedSearch> searchCache;
     std::function<void(const string& text)> onSave;
     std::function<void(const ImGuiIO& io)> onKeyPress;
   };
@@ -0,0 +1,203 @@
+#include "FileTree.h"
+#include "ThreadPool.h"
+#include "Tooling.h"
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+namespace Helper {
+
+bool FileTree::hidden(const string &name) {
+  return name.ends_with("obj") || name.ends_with("proj");
+}
+
+// ASCII letters compare ignoring case, names only differing in case still
+// get a fixed order.
+static int compareNames(const string &a, const string &b) {
+  auto size = std::min(a.size(), b.size());
+  for (size_t i = 0; i < size; i++) {
+    auto x = std::tolower((unsigned char)a[i]);
+    auto y = std::tolower((unsigned char)b[i]);
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  if (a.size() != b.size()) {
+    return a.size() < b.size() ? -1 : 1;
+  }
+  return a.compare(b);
+}
+
+bool FileTree::before(const Node &a, const Node &b) {
+  auto aProperties = a.isDirectory && a.name == "Properties";
+  auto bProperties = b.isDirectory && b.name == "Properties";
+  if (aProperties != bProperties) {
+    return aProperties;
+  }
+  if (a.isDirectory != b.isDirectory) {
+    return a.isDirectory;
+  }
+  return compareNames(a.name, b.name) < 0;
+}
+
+FileTree::Node *FileTree::find(std::vector<Node> &children, size_t end,
+                               const string &name) {
+  // The sort puts directories apart from files, so look among both.
+  for (auto isDirectory : {true, false}) {
+    Node probe{name, path(), isDirectory};
+    auto found = std::lower_bound(children.begin(), children.begin() + end,
+                                  probe, before);
+    if (found != children.begin() + end && found->name == name &&
+        found->isDirectory == isDirectory) {
+      return &*found;
+    }
+  }
+  return nullptr;
+}
+
+void FileTree::read(Node &directory) {
+  if (watcher) {
+    watcher->watch(directory.file);
+  }
+
+  std::error_code ec;
+  for (auto &entry : directory_iterator(directory.file, ec)) {
+    auto name = entry.path().filename().string();
+    if (hidden(name)) {
+      continue;
+    }
+
+    auto isDirectory = entry.is_directory(ec);
+    if (!isDirectory && !entry.is_regular_file(ec)) {
+      continue;
+    }
+
+    auto &node = directory.children.emplace_back();
+    node.name = std::move(name);
+    node.file = entry.path();
+    node.isDirectory = isDirectory;
+    if (isDirectory) {
+      read(node);
+    }
+  }
+  std::sort(directory.children.begin(), directory.children.end(), before);
+}
+
+void FileTree::build() {
+  if (building.exchange(true)) {
+    return;
+  }
+
+  auto self = shared_from_this();
+  ThreadPool::shared().submit([self]() {
+    PROFILE_START;
+    self->top.name = self->root.filename().string();
+    self->top.file = self->root;
+    self->top.isDirectory = true;
+    self->read(self->top);
+    self->built = true;
+  });
+}
+
+void FileTree::apply(const std::vector<FileWatcher::Change> &changes) {
+  if (!ready()) {
+    early.insert(early.end(), changes.begin(), changes.end());
+    return;
+  }
+
+  PROFILE_START;
+  if (!early.empty()) {
+    auto replay = std::move(early);
+    early.clear();
+    apply(replay);
+  }
+
+  // Grouped by directory, so each one is sorted once however many of its
+  // entries changed.
+  std::map<path, std::vector<const path *>> byDirectory;
+  for (auto &change : changes) {
+    if (change.kind == FileWatcher::Kind::Overflow) {
+      top.children.clear();
+      read(top);
+      return;
+    }
+
+    auto relative = change.file.lexically_relative(root);
+    if (relative.empty() || relative == "." || *relative.begin() == "..") {
+      continue;
+    }
+    byDirectory[relative.parent_path()].push_back(&change.file);
+  }
+
+  // Parents come before their children, so the changes below a directory
+  // that was read in this batch are already in the tree.
+  std::set<path> fresh;
+  for (auto &[directory, files] : byDirectory) {
+    auto node = &top;
+    for (auto &part : directory) {
+      node = find(node->children, node->children.size(), part.string());
+      if (!node || !node->isDirectory || fresh.count(node->file)) {
+        node = nullptr;
+        break;
+      }
+    }
+    if (node) {
+      update(*node, files, fresh);
+    }
+  }
+}
+
+void FileTree::update(Node &directory, const std::vector<const path *> &files,
+                      std::set<path> &fresh) {
+  // New entries go behind the sorted ones until the sort at the end.
+  auto sorted = directory.children.size();
+  std::vector<bool> removed(sorted);
+  for (auto file : files) {
+    auto name = file->filename().string();
+    if (hidden(name)) {
+      continue;
+    }
+
+    std::error_code ec;
+    auto status = std::filesystem::status(*file, ec);
+    auto exists = !ec && std::filesystem::exists(status);
+    auto isDirectory = exists && std::filesystem::is_directory(status);
+    if (exists && !isDirectory && !std::filesystem::is_regular_file(status)) {
+      exists = false;
+    }
+
+    auto node = find(directory.children, sorted, name);
+    if (node && exists && node->isDirectory == isDirectory) {
+      // Whatever was below a directory that came back is read again.
+      if (isDirectory) {
+        node->children.clear();
+        read(*node);
+        fresh.insert(node->file);
+      }
+      continue;
+    }
+    if (node) {
+      removed[node - directory.children.data()] = true;
+    }
+    if (exists) {
+      auto &added = directory.children.emplace_back();
+      added.name = std::move(name);
+      added.file = *file;
+      added.isDirectory = isDirectory;
+      if (isDirectory) {
+        read(added);
+        fresh.insert(added.file);
+      }
+    }
+  }
+
+  size_t index = 0;
+  std::erase_if(directory.children, [&](const Node &) {
+    auto gone = index < sorted && removed[index];
+    index++;
+    return gone;
+  });
+  std::sort(directory.children.begin(), directory.children.end(), before);
+}
+
+} // namespace Helper
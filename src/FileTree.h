@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Constants.h"
+#include "FileWatcher.h"
+#include <atomic>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace Helper {
+
+// The files below a project directory as the Solution Explorer lists them,
+// read once on the shared thread pool so drawing the explorer touches no
+// disk. Every directory holds Properties first, then its other directories,
+// then its files, each group by name ignoring case. Build output and project
+// files are left out. With a watcher, batches of changes are patched in
+// without reading the tree again.
+struct FileTree : std::enable_shared_from_this<FileTree> {
+  FileTree(path root, std::shared_ptr<FileWatcher> watcher)
+      : root(std::move(root)), watcher(std::move(watcher)), building(false),
+        built(false) {}
+
+  struct Node {
+    string name;
+    path file;
+    bool isDirectory = false;
+    std::vector<Node> children = {};
+  };
+
+  static bool hidden(const string &name);
+  // The order of the children of a directory.
+  static bool before(const Node &a, const Node &b);
+  static Node *find(std::vector<Node> &children, size_t end,
+                    const string &name);
+  // Watches every directory before reading it.
+  void read(Node &directory);
+
+  // Reads the tree on the shared thread pool, the nodes may only be looked
+  // at once ready.
+  void build();
+  bool ready() const { return built.load(); }
+  // Only the directories holding changed paths are looked at, they are
+  // checked against the disk, so changes may be applied more than once. A
+  // batch arriving while the tree is still read is kept until it is ready.
+  void apply(const std::vector<FileWatcher::Change> &changes);
+  // Directories read while updating go to fresh.
+  void update(Node &directory, const std::vector<const path *> &files,
+              std::set<path> &fresh);
+
+  path root;
+  std::shared_ptr<FileWatcher> watcher;
+  Node top;
+  std::vector<FileWatcher::Change> early;
+  std::atomic<bool> building;
+  std::atomic<bool> built;
+};
+
+} // namespace Helper
@@ -0,0 +1,178 @@
+#include "FileWatcher.h"
+#include "Tooling.h"
+
+#if defined(__linux__)
+#include <atomic>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace Helper {
+
+bool FileWatcher::take(std::vector<Change> &changes) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (pending.empty()) {
+    return false;
+  }
+
+  auto now = Clock::now();
+  if (now - last < QuietTime && now - first < MaxDelay) {
+    return false;
+  }
+
+  changes = std::move(pending);
+  pending.clear();
+  positions.clear();
+  return true;
+}
+
+void FileWatcher::record(const path &file, Kind kind) {
+  std::lock_guard<std::mutex> guard(lock);
+  last = Clock::now();
+  if (pending.empty()) {
+    first = last;
+  }
+
+  auto found = positions.emplace(file.string(), pending.size());
+  if (found.second) {
+    pending.push_back({file, kind});
+    return;
+  }
+
+  // The last event tells the state, only a file that came and was written
+  // to is still new.
+  auto &change = pending[found.first->second];
+  if (change.kind != Kind::Added || kind != Kind::Modified) {
+    change.kind = kind;
+  }
+}
+
+#if defined(__linux__)
+
+// One inotify instance for every watched directory, read on a thread of its
+// own. The kernel drops events once its queue is full, which comes through
+// as an overflow.
+struct InotifyWatcher : FileWatcher {
+  explicit InotifyWatcher(int fd) : fd(fd), stopping(false) {
+    reader = std::thread([this]() { run(); });
+  }
+
+  ~InotifyWatcher() override {
+    stopping = true;
+    reader.join();
+    close(fd);
+  }
+
+  static constexpr uint32_t Events = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                     IN_CLOSE_WRITE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_DELETE_SELF;
+
+  void watch(const path &directory) override {
+    auto wd = inotify_add_watch(fd, directory.c_str(), Events | IN_ONLYDIR);
+    if (wd < 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(watchLock);
+    directories[wd] = directory;
+  }
+
+  void run() {
+    // Room for plenty of events, aligned for the struct they start with.
+    alignas(inotify_event) char buffer[64 << 10];
+    pollfd waiting{fd, POLLIN, 0};
+    while (!stopping) {
+      if (poll(&waiting, 1, 100) <= 0) {
+        continue;
+      }
+
+      auto size = read(fd, buffer, sizeof(buffer));
+      if (size <= 0) {
+        continue;
+      }
+
+      PROFILE_START;
+      for (auto at = buffer; at < buffer + size;) {
+        auto event = (const inotify_event *)at;
+        handle(*event);
+        at += sizeof(inotify_event) + event->len;
+      }
+    }
+  }
+
+  void handle(const inotify_event &event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      record(path(), Kind::Overflow);
+      return;
+    }
+
+    path directory;
+    {
+      std::lock_guard<std::mutex> guard(watchLock);
+      auto found = directories.find(event.wd);
+      if (found == directories.end()) {
+        return;
+      }
+      directory = found->second;
+      if (event.mask & IN_IGNORED) {
+        directories.erase(found);
+        return;
+      }
+    }
+
+    if (event.len == 0) {
+      // The directory itself is gone, its parent reports that.
+      return;
+    }
+
+    auto file = directory / event.name;
+    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+      record(file, Kind::Added);
+    } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+      // A directory moved away keeps its watches under the old paths.
+      if (event.mask & IN_ISDIR) {
+        forget(file);
+      }
+      record(file, Kind::Removed);
+    } else if (event.mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+      record(file, Kind::Modified);
+    }
+  }
+
+  void forget(const path &directory) {
+    auto prefix = directory.string() + "/";
+    std::lock_guard<std::mutex> guard(watchLock);
+    for (auto it = directories.begin(); it != directories.end();) {
+      auto name = it->second.string();
+      if (name == directory.string() || name.starts_with(prefix)) {
+        inotify_rm_watch(fd, it->first);
+        it = directories.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  int fd;
+  std::atomic<bool> stopping;
+  std::thread reader;
+  std::mutex watchLock;
+  std::unordered_map<int, path> directories;
+};
+
+std::shared_ptr<FileWatcher> FileWatcher::create() {
+  auto fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  return std::make_shared<InotifyWatcher>(fd);
+}
+
+#else
+
+std::shared_ptr<FileWatcher> FileWatcher::create() { return nullptr; }
+
+#endif
+
+} // namespace Helper
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Constants.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Helper {
+
+// Reports files and directories that changed on disk. A backend per platform
+// turns its native events into changes. They are handed out in batches: a
+// batch is only complete once no event came for QuietTime, so a branch
+// switch or a code generator run arrives as one. A path that changed several
+// times within a batch is reported once.
+//
+// Directories are watched one by one, without the ones below them. Whoever
+// reads a directory watches it first, so nothing changes unnoticed in
+// between.
+struct FileWatcher {
+  enum class Kind : uint8_t { Added, Removed, Modified, Overflow };
+
+  struct Change {
+    path file;
+    Kind kind;
+  };
+
+  // Events that keep coming still end a batch after MaxDelay.
+  static constexpr std::chrono::milliseconds QuietTime{100};
+  static constexpr std::chrono::milliseconds MaxDelay{1000};
+
+  // The backend of this platform, null where there is none yet.
+  static std::shared_ptr<FileWatcher> create();
+
+  virtual ~FileWatcher() = default;
+
+  // Safe to call from any thread.
+  virtual void watch(const path &directory) = 0;
+
+  // Moves a complete batch into changes, false if there is none.
+  bool take(std::vector<Change> &changes);
+
+  // Called by the backend as events come in. Overflow means events were
+  // lost and everything watched has to be looked at again.
+  void record(const path &file, Kind kind);
+
+  using Clock = std::chrono::steady_clock;
+
+  std::mutex lock;
+  std::vector<Change> pending;
+  // Position of each path in pending.
+  std::unordered_map<string, size_t> positions;
+  Clock::time_point first;
+  Clock::time_point last;
+};
+
+} // namespace Helper
@@ -0,0 +1,59 @@
+#include "GlyphCache.h"
+#include "Tooling.h"
+
+namespace UI {
+
+// Packs the raw bytes of one glyph, so malformed sequences never share an
+// entry with a valid codepoint.
+static inline uint32_t glyphKey(const char *text, int length) {
+  uint32_t key = 0;
+  for (int i = 0; i < length && i < 4; i++) {
+    key = (key << 8) | (uint8_t)text[i];
+  }
+  return key;
+}
+
+bool GlyphCache::setFont(ImFont *newFont, float newFontSize) {
+  if (font == newFont && fontSize == newFontSize) {
+    return false;
+  }
+
+  PROFILE_START;
+  font = newFont;
+  fontSize = newFontSize;
+  others.clear();
+  generation++;
+
+  char buf[2] = {0, 0};
+  for (int c = 0; c < 128; c++) {
+    buf[0] = (char)c;
+    ascii[c] = measure(buf, 1);
+  }
+  spaceWidth = ascii[' '];
+  return true;
+}
+
+float GlyphCache::advance(const char *text, int length) {
+  auto c = (uint8_t)text[0];
+  if (c < 0x80) {
+    return ascii[c];
+  }
+
+  auto key = glyphKey(text, length);
+  auto it = others.find(key);
+  if (it != others.end()) {
+    return it->second;
+  }
+
+  auto width = measure(text, length);
+  others.emplace(key, width);
+  return width;
+}
+
+float GlyphCache::measure(const char *text, int length) const {
+  return font->CalcTextSizeA(fontSize, FLT_MAX, -1.0f, text, text + length,
+                             nullptr)
+      .x;
+}
+
+} // namespace UI
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../vendor/imgui/imgui.h"
+#include <cstdint>
+#include <unordered_map>
+
+namespace UI {
+
+// Glyph -> advance cache for one font at one size. ASCII lives in a dense
+// table, everything else is looked up in a hash map keyed by the glyph's
+// UTF-8 bytes and measured on the first miss.
+struct GlyphCache {
+  GlyphCache() : font(nullptr), fontSize(0.f), spaceWidth(0.f), generation(0) {}
+
+  bool setFont(ImFont *newFont, float newFontSize);
+  float advance(const char *text, int length);
+  float measure(const char *text, int length) const;
+
+  ImFont *font;
+  float fontSize;
+  float spaceWidth;
+  // Bumped whenever the cached advances are thrown away.
+  uint32_t generation;
+  float ascii[128];
+  std::unordered_map<uint32_t, float> others;
+};
+
+} // namespace UI
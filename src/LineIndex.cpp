@@ -0,0 +1,355 @@
+#include "LineIndex.h"
+#include "LineScan.h"
+#include "Tooling.h"
+#include <algorithm>
+
+namespace Text {
+
+static inline size_t subtreeLines(const std::vector<LineIndex::Block> &blocks,
+                                  int node) {
+  return node < 0 ? 0 : blocks[node].subtreeLines;
+}
+
+static inline size_t subtreeBytes(const std::vector<LineIndex::Block> &blocks,
+                                  int node) {
+  return node < 0 ? 0 : blocks[node].subtreeBytes;
+}
+
+void LineIndex::build(const char *data, size_t size) {
+  std::vector<size_t> lengths;
+  scanLines(data, size, lengths);
+  build(lengths);
+}
+
+void LineIndex::build(const std::vector<size_t> &lengths) {
+  PROFILE_START;
+  clear();
+  appendBlocks(root, lengths, 0, lengths.size());
+}
+
+void LineIndex::clear() {
+  blocks.clear();
+  freeList.clear();
+  root = -1;
+}
+
+int LineIndex::lineCount() const {
+  return root < 0 ? 1 : (int)blocks[root].subtreeLines;
+}
+
+size_t LineIndex::size() const { return subtreeBytes(blocks, root); }
+
+size_t LineIndex::lineStart(int line) const {
+  int block;
+  size_t index, offset;
+  if (!findLine(line, block, index, offset)) {
+    return size();
+  }
+  return offset;
+}
+
+size_t LineIndex::lineSpan(int line) const {
+  int block;
+  size_t index, offset;
+  if (!findLine(line, block, index, offset)) {
+    return 0;
+  }
+  auto &b = blocks[block];
+  auto end = index + 1 < b.starts.size() ? b.starts[index + 1] : b.bytes;
+  return end - b.starts[index];
+}
+
+int LineIndex::lineOfOffset(size_t offset) const {
+  size_t line = 0;
+  int node = root;
+  while (node >= 0) {
+    auto &b = blocks[node];
+    auto leftBytes = subtreeBytes(blocks, b.left);
+
+    if (offset < leftBytes) {
+      node = b.left;
+      continue;
+    }
+
+    offset -= leftBytes;
+    line += subtreeLines(blocks, b.left);
+
+    if (offset < b.bytes) {
+      auto it = std::upper_bound(b.starts.begin(), b.starts.end(), offset);
+      return (int)(line + (it - b.starts.begin()) - 1);
+    }
+
+    offset -= b.bytes;
+    line += b.starts.size();
+    node = b.right;
+  }
+  return lineCount() - 1;
+}
+
+void LineIndex::insert(size_t offset, const char *text, size_t length) {
+  PROFILE_START;
+  auto line = lineOfOffset(offset);
+  auto start = lineStart(line);
+  auto span = lineSpan(line);
+  auto column = offset - start;
+
+  std::vector<size_t> lengths;
+  scanLines(text, length, lengths);
+
+  if (lengths.size() == 1) {
+    resizeLine(line, (ptrdiff_t)length);
+    return;
+  }
+
+  lengths.front() += column;
+  lengths.back() += span - column;
+  replaceLines(line, 1, lengths);
+}
+
+void LineIndex::erase(size_t offset, size_t length) {
+  PROFILE_START;
+  auto first = lineOfOffset(offset);
+  auto last = lineOfOffset(offset + length);
+
+  if (first == last) {
+    resizeLine(first, -(ptrdiff_t)length);
+    return;
+  }
+
+  auto end = lineStart(last) + lineSpan(last);
+  auto remaining = (offset - lineStart(first)) + (end - (offset + length));
+
+  replaceLines(first, last - first + 1, {remaining});
+}
+
+void LineIndex::replaceLines(int first, int count,
+                             const std::vector<size_t> &lengths) {
+  int firstBlock, lastBlock;
+  auto start = blockFirstLine(first, firstBlock);
+  auto lastStart = blockFirstLine(first + std::max(count, 1) - 1, lastBlock);
+  auto end = lastStart + (int)blocks[lastBlock].starts.size();
+
+  int left, middle, right;
+  split(root, start, left, middle);
+  split(middle, end - start, middle, right);
+
+  std::vector<size_t> merged;
+  merged.reserve(end - start + lengths.size());
+  gather(middle, merged);
+  freeBlocks(middle);
+
+  merged.erase(merged.begin() + (first - start),
+               merged.begin() + (first - start + count));
+  merged.insert(merged.begin() + (first - start), lengths.begin(),
+                lengths.end());
+
+  // Fold the next block in so that edits do not leave tiny blocks behind.
+  if (merged.size() < BlockSize / 2 && right >= 0) {
+    int next = right;
+    while (blocks[next].left >= 0) {
+      next = blocks[next].left;
+    }
+    int head;
+    split(right, blocks[next].starts.size(), head, right);
+    gather(head, merged);
+    freeBlocks(head);
+  }
+
+  appendBlocks(left, merged, 0, merged.size());
+  root = merge(left, right);
+}
+
+void LineIndex::resizeLine(int line, ptrdiff_t delta) {
+  // Every block on the way down contains the line, so the totals can be
+  // patched while descending.
+  size_t remaining = (size_t)line;
+  int node = root;
+  while (node >= 0) {
+    auto &b = blocks[node];
+    b.subtreeBytes += delta;
+
+    auto leftLines = subtreeLines(blocks, b.left);
+    if (remaining < leftLines) {
+      node = b.left;
+      continue;
+    }
+
+    remaining -= leftLines;
+    if (remaining < b.starts.size()) {
+      for (auto i = remaining + 1; i < b.starts.size(); i++) {
+        b.starts[i] += (int32_t)delta;
+      }
+      b.bytes += delta;
+      return;
+    }
+
+    remaining -= b.starts.size();
+    node = b.right;
+  }
+}
+
+bool LineIndex::findLine(int line, int &block, size_t &index,
+                         size_t &offset) const {
+  if (line < 0) {
+    return false;
+  }
+
+  size_t remaining = (size_t)line;
+  size_t base = 0;
+  int node = root;
+  while (node >= 0) {
+    auto &b = blocks[node];
+    auto leftLines = subtreeLines(blocks, b.left);
+
+    if (remaining < leftLines) {
+      node = b.left;
+      continue;
+    }
+
+    remaining -= leftLines;
+    base += subtreeBytes(blocks, b.left);
+
+    if (remaining < b.starts.size()) {
+      block = node;
+      index = remaining;
+      offset = base + b.starts[remaining];
+      return true;
+    }
+
+    remaining -= b.starts.size();
+    base += b.bytes;
+    node = b.right;
+  }
+  return false;
+}
+
+int LineIndex::blockFirstLine(int line, int &block) const {
+  size_t index, offset;
+  if (!findLine(std::min(line, lineCount() - 1), block, index, offset)) {
+    block = -1;
+    return 0;
+  }
+  return std::min(line, lineCount() - 1) - (int)index;
+}
+
+void LineIndex::appendBlocks(int &tree, const std::vector<size_t> &lengths,
+                             size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i += BlockSize) {
+    auto node = newBlock();
+    auto &b = blocks[node];
+    auto last = std::min(end, i + BlockSize);
+
+    size_t bytes = 0;
+    for (size_t j = i; j < last; j++) {
+      b.starts.push_back((uint32_t)bytes);
+      bytes += lengths[j];
+    }
+    b.bytes = bytes;
+    update(node);
+
+    tree = merge(tree, node);
+  }
+}
+
+void LineIndex::gather(int node, std::vector<size_t> &lengths) const {
+  if (node < 0) {
+    return;
+  }
+
+  auto &b = blocks[node];
+  gather(b.left, lengths);
+  for (size_t i = 0; i < b.starts.size(); i++) {
+    auto end = i + 1 < b.starts.size() ? b.starts[i + 1] : b.bytes;
+    lengths.push_back(end - b.starts[i]);
+  }
+  gather(b.right, lengths);
+}
+
+int LineIndex::newBlock() {
+  int node;
+  if (!freeList.empty()) {
+    node = freeList.back();
+    freeList.pop_back();
+  } else {
+    node = (int)blocks.size();
+    blocks.emplace_back();
+  }
+
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  auto &b = blocks[node];
+  b.left = -1;
+  b.right = -1;
+  b.priority = seed;
+  b.starts.clear();
+  b.bytes = 0;
+  b.subtreeLines = 0;
+  b.subtreeBytes = 0;
+  return node;
+}
+
+void LineIndex::freeBlocks(int node) {
+  if (node < 0) {
+    return;
+  }
+  freeBlocks(blocks[node].left);
+  freeBlocks(blocks[node].right);
+  freeList.push_back(node);
+}
+
+void LineIndex::update(int node) {
+  auto &b = blocks[node];
+  b.subtreeLines = subtreeLines(blocks, b.left) + b.starts.size() +
+                   subtreeLines(blocks, b.right);
+  b.subtreeBytes = subtreeBytes(blocks, b.left) + b.bytes +
+                   subtreeBytes(blocks, b.right);
+}
+
+void LineIndex::split(int node, size_t lines, int &left, int &right) {
+  if (node < 0) {
+    left = right = -1;
+    return;
+  }
+
+  // Only ever called on block boundaries, blocks are never cut in half.
+  auto leftLines = subtreeLines(blocks, blocks[node].left);
+  auto count = blocks[node].starts.size();
+
+  if (lines <= leftLines) {
+    int l;
+    split(blocks[node].left, lines, left, l);
+    blocks[node].left = l;
+    update(node);
+    right = node;
+  } else {
+    int r;
+    auto rest = lines > leftLines + count ? lines - leftLines - count : 0;
+    split(blocks[node].right, rest, r, right);
+    blocks[node].right = r;
+    update(node);
+    left = node;
+  }
+}
+
+int LineIndex::merge(int left, int right) {
+  if (left < 0) {
+    return right;
+  }
+  if (right < 0) {
+    return left;
+  }
+
+  if (blocks[left].priority > blocks[right].priority) {
+    blocks[left].right = merge(blocks[left].right, right);
+    update(left);
+    return left;
+  }
+
+  blocks[right].left = merge(left, blocks[right].left);
+  update(right);
+  return right;
+}
+
+} // namespace Text
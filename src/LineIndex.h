@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Text {
+
+// Line bookkeeping for a flat UTF-8 buffer. Line lengths (including their
+// line feed) are grouped into blocks that live in an implicit treap ordered
+// by line number, so line -> offset, offset -> line and edits are O(log n)
+// plus a bounded amount of work inside one block.
+struct LineIndex {
+  LineIndex() : root(-1) {}
+
+  static constexpr size_t BlockSize = 256;
+
+  struct Block {
+    int left;
+    int right;
+    uint32_t priority;
+    // Byte offsets of each line relative to the start of the block.
+    std::vector<uint32_t> starts;
+    size_t bytes;
+    size_t subtreeLines;
+    size_t subtreeBytes;
+  };
+
+  void build(const char *data, size_t size);
+  void build(const std::vector<size_t> &lengths);
+  void clear();
+
+  int lineCount() const;
+  size_t size() const;
+  size_t lineStart(int line) const;
+  // Length including the trailing line feed, if any.
+  size_t lineSpan(int line) const;
+  int lineOfOffset(size_t offset) const;
+
+  void insert(size_t offset, const char *text, size_t length);
+  void erase(size_t offset, size_t length);
+  void replaceLines(int first, int count, const std::vector<size_t> &lengths);
+  void resizeLine(int line, ptrdiff_t delta);
+
+  bool findLine(int line, int &block, size_t &index, size_t &offset) const;
+  int blockFirstLine(int line, int &block) const;
+  void appendBlocks(int &tree, const std::vector<size_t> &lengths,
+                    size_t begin, size_t end);
+  void gather(int node, std::vector<size_t> &lengths) const;
+  int newBlock();
+  void freeBlocks(int node);
+  void update(int node);
+  void split(int node, size_t lines, int &left, int &right);
+  int merge(int left, int right);
+
+  std::vector<Block> blocks;
+  std::vector<int> freeList;
+  int root;
+  uint32_t seed = 0x2545F491u;
+};
+
+} // namespace Text
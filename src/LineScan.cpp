@@ -0,0 +1,138 @@
+#include "LineScan.h"
+#include "Tooling.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) ||            \
+    defined(__i386__)
+#define LINE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Text {
+
+static inline void emitLines(uint32_t mask, size_t base, size_t &last,
+                             std::vector<size_t> &lengths) {
+  while (mask) {
+    auto end = base + countTrailingZeros(mask) + 1;
+    lengths.push_back(end - last);
+    last = end;
+    mask &= mask - 1;
+  }
+}
+
+static bool scanScalar(const char *data, size_t begin, size_t size,
+                       size_t &last, std::vector<size_t> &lengths) {
+  bool sawCR = false;
+  for (size_t i = begin; i < size; i++) {
+    if (data[i] == '\n') {
+      lengths.push_back(i + 1 - last);
+      last = i + 1;
+    } else if (data[i] == '\r') {
+      sawCR = true;
+    }
+  }
+  return sawCR;
+}
+
+#if LINE_SCAN_X86
+
+static bool scanSSE2(const char *data, size_t size, size_t &last,
+                     std::vector<size_t> &lengths) {
+  auto lf = _mm_set1_epi8('\n');
+  auto cr = _mm_set1_epi8('\r');
+  auto anyCR = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    auto chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    anyCR = _mm_or_si128(anyCR, _mm_cmpeq_epi8(chunk, cr));
+    auto mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf));
+    emitLines(mask, i, last, lengths);
+  }
+
+  bool sawCR = _mm_movemask_epi8(anyCR) != 0;
+  return scanScalar(data, i, size, last, lengths) || sawCR;
+}
+
+#if !defined(_MSC_VER)
+__attribute__((target("avx2")))
+#endif
+static bool scanAVX2(const char *data, size_t size, size_t &last,
+                     std::vector<size_t> &lengths) {
+  auto lf = _mm256_set1_epi8('\n');
+  auto cr = _mm256_set1_epi8('\r');
+  auto anyCR = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    auto chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    anyCR = _mm256_or_si256(anyCR, _mm256_cmpeq_epi8(chunk, cr));
+    auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf));
+    emitLines(mask, i, last, lengths);
+  }
+
+  bool sawCR = _mm256_movemask_epi8(anyCR) != 0;
+  return scanScalar(data, i, size, last, lengths) || sawCR;
+}
+
+static bool hasAVX2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+
+  // AVX2 also needs the OS to save the upper register halves.
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+bool scanLines(const char *data, size_t size, std::vector<size_t> &lengths) {
+  PROFILE_START;
+  // Roughly one line per 64 bytes is typical for source code.
+  lengths.reserve(lengths.size() + size / 64 + 1);
+
+  size_t last = 0;
+  bool sawCR;
+#if LINE_SCAN_X86
+  static const bool avx2 = hasAVX2();
+  sawCR = avx2 ? scanAVX2(data, size, last, lengths)
+               : scanSSE2(data, size, last, lengths);
+#else
+  sawCR = scanScalar(data, 0, size, last, lengths);
+#endif
+
+  lengths.push_back(size - last);
+  return sawCR;
+}
+
+void stripCarriageReturns(const char *data, size_t size, string &out) {
+  PROFILE_START;
+  out.reserve(out.size() + size);
+
+  auto end = data + size;
+  while (data < end) {
+    auto cr = (const char *)memchr(data, '\r', end - data);
+    if (!cr) {
+      out.append(data, end - data);
+      break;
+    }
+    out.append(data, cr - data);
+    data = cr + 1;
+  }
+}
+
+} // namespace Text
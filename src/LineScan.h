@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Constants.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Text {
+
+// Index of the lowest set bit, mask must not be zero.
+inline int countTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Appends the length of every line in data to lengths, line feeds included.
+// The last entry is whatever follows the final line feed, so there is always
+// one more entry than there are line feeds. Returns whether a carriage return
+// was seen. Uses AVX2 or SSE2 when the CPU has them.
+bool scanLines(const char *data, size_t size, std::vector<size_t> &lengths);
+
+// Copies data into out without any carriage returns.
+void stripCarriageReturns(const char *data, size_t size, string &out);
+
+} // namespace Text
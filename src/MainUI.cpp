@@ -2,10 +2,17 @@
 #include "Tooling.h"
 #include "../vendor/IconFontCppHeaders/IconsFontAwesome5.h"
 #include "EditorUI.h"
+#include "FileTree.h"
+#include "MappedFile.h"
+#include "SolutionSearch.h"
+#include "StorageFile.h"
+#include "ThreadPool.h"
 #include "WelcomeUI.h"
 #include <fstream>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 
 namespace UI {
@@ -13,6 +20,15 @@ namespace UI {
   struct EditorWrapper {
     EditorUI *editor;
     string name;
+    path file;
+    // Line and byte column to move the cursor to on the next frame, -1 for
+    // none. Unlike a file offset they survive the '\r's the buffer drops.
+    int revealLine = -1;
+    int revealColumn = 0;
+    // The file as the editor last read or wrote it.
+    uint64_t diskSize = 0;
+    uint64_t diskStamp = 0;
+    bool changedOnDisk = false;
   };
   
   static Project::VSSolution *g_sln = nullptr;
@@ -20,11 +36,32 @@ namespace UI {
   static bool g_renderSolutionExplorer = true;
   static std::vector<EditorWrapper *> g_editors;
   static std::mutex g_newEditorMutex;
-  
-  inline bool doRenderInSolutionExplorer(const std::string &name) {
-    return !(name.ends_with("obj") || name.ends_with("proj") ||
-             name == "Properties");
-  }
+  static Project::ProjectIndex g_currentProject = Project::NoProject;
+  static bool g_renderFindResults = false;
+  static std::shared_ptr<Text::SolutionSearch> g_findAll;
+  static std::vector<Text::SolutionSearch::FileResult> g_findResults;
+  static std::shared_ptr<Text::TrigramIndex> g_index;
+  // One per project, read the first time the project is expanded.
+  static std::vector<std::shared_ptr<Helper::FileTree>> g_fileTrees;
+  // Null where the platform has no watcher yet.
+  static std::shared_ptr<Helper::FileWatcher> g_watcher;
+  // Patches the editors holding files hit by a solution-wide replace.
+  static Text::Replacer g_openReplacer;
+  static size_t g_openReplacements = 0;
+  // Set once a replace finished. Open editors are only patched if the files
+  // on disk were replaced, the results then only hold files with matches.
+  static bool g_openPatched = false;
+  // Rows of the Find Results, a file or one of its matches, so only the
+  // visible ones are drawn. Rebuilt when results come or go or a file is
+  // expanded or collapsed.
+  struct FindRow {
+    uint32_t result;
+    // -1 for the row of the file itself.
+    int32_t match;
+  };
+  static std::vector<FindRow> g_findRows;
+  static size_t g_findRowsResults = 0;
+  static bool g_findRowsStale = true;
   
   void MainUI::keyPress(const ImGuiIO& io) {
     auto shift = io.KeyShift;
@@ -37,85 +74,180 @@ namespace UI {
     }
   }
   
-  void renderSlnExplorerRecursive(const directory_entry &dir,
-                                  bool propertiesRendered) {
-    
-    if (!propertiesRendered) {
-      for (auto &entry : directory_iterator(dir)) {
-        if (entry.is_directory() &&
-            entry.path().filename().string() == "Properties") {
-          propertiesRendered = true;
-          if (ImGui::TreeNode(entry.path().filename().string().c_str())) {
-            renderSlnExplorerRecursive(entry, propertiesRendered);
-            ImGui::TreePop();
-          }
-          break;
+  void openFile(const path &file, int revealLine, int revealColumn) {
+    {
+      std::lock_guard<std::mutex> guard(g_newEditorMutex);
+      for (auto wrapper : g_editors) {
+        if (wrapper->file == file) {
+          wrapper->revealLine = revealLine;
+          wrapper->revealColumn = revealColumn;
+          return;
         }
       }
     }
     
-    for (auto &entry : directory_iterator(dir)) {
-      if (entry.is_directory() &&
-          doRenderInSolutionExplorer(entry.path().filename().string())) {
-        if (ImGui::TreeNode(entry.path().filename().string().c_str())) {
-          renderSlnExplorerRecursive(entry, propertiesRendered);
-          ImGui::TreePop();
-        }
+    // Files opened from search results may lie outside every file tree.
+    if (g_watcher) {
+      g_watcher->watch(file.parent_path());
+    }
+    
+    std::thread([file, revealLine, revealColumn]() {
+                  Helper::MappedFile mapped;
+                  if (!mapped.open(file)) {
+                    return;
+                  }
+                  
+                  EditorWrapper *wrapper = new EditorWrapper;
+                  EditorUI *newEditor = new EditorUI;
+                  SearchAndReplaceUI *searchAndReplace = new SearchAndReplaceUI;
+                  wrapper->editor = newEditor;
+                  wrapper->name = file.filename().string();
+                  wrapper->file = file;
+                  wrapper->revealLine = revealLine;
+                  wrapper->revealColumn = revealColumn;
+                  Helper::fileStamp(file, wrapper->diskSize, wrapper->diskStamp);
+                  
+                  newEditor->setText(mapped.data, mapped.size);
+                  newEditor->setSearchAndReplace(searchAndReplace);
+                  
+                  newEditor->onSave = [file, wrapper](const string& text) {
+                    std::ofstream ofs(file.c_str(), std::ios::trunc);
+                    ofs << text;
+                    ofs.close();
+                    // Our own write is no change from outside.
+                    Helper::fileStamp(file, wrapper->diskSize, wrapper->diskStamp);
+                    wrapper->changedOnDisk = false;
+                    
+                    // Trigrams of a large file take a while, keep them off the UI thread.
+                    if (g_index) {
+                      Helper::ThreadPool::shared().submit([index = g_index, file, text,
+                                                           size = wrapper->diskSize,
+                                                           stamp = wrapper->diskStamp]() {
+                        index->update(file, text, size, stamp);
+                      });
+                    }
+                  };
+                  
+                  g_newEditorMutex.lock();
+                  g_editors.push_back(wrapper);
+                  g_newEditorMutex.unlock();
+                }).detach();
+  }
+  
+  bool reloadEditor(EditorWrapper *wrapper) {
+    Helper::MappedFile mapped;
+    if (!mapped.open(wrapper->file)) {
+      return false;
+    }
+    
+    auto editor = wrapper->editor;
+    auto cursor = editor->editorState.cursorPosition;
+    editor->clearSearch();
+    editor->setText(mapped.data, mapped.size);
+    editor->editorState.cursorPosition = editor->sanitizeCoordinates(cursor);
+    editor->textChanged = false;
+    Helper::fileStamp(wrapper->file, wrapper->diskSize, wrapper->diskStamp);
+    wrapper->changedOnDisk = false;
+    return true;
+  }
+  
+  // Patches the file trees with the latest batch of changes and brings the
+  // editors whose file is no longer what they read or wrote up to date, or
+  // flags them when they hold edits.
+  void pollFileChanges() {
+    std::vector<Helper::FileWatcher::Change> changes;
+    if (!g_watcher || !g_watcher->take(changes)) {
+      return;
+    }
+    
+    PROFILE_START;
+    for (auto &tree : g_fileTrees) {
+      if (tree) {
+        tree->apply(changes);
+      }
+    }
+    
+    std::lock_guard<std::mutex> guard(g_newEditorMutex);
+    std::unordered_map<string, EditorWrapper *> editors;
+    for (auto wrapper : g_editors) {
+      if (!wrapper->file.empty()) {
+        editors[wrapper->file.lexically_normal().string()] = wrapper;
       }
     }
     
-    for (auto &entry : directory_iterator(dir)) {
-      if (!entry.is_directory() &&
-          doRenderInSolutionExplorer(entry.path().filename().string())) {
-        ImGui::TreeNodeEx(entry.path().filename().string().c_str(),
+    // An editor without edits just reads the file again, one with edits keeps
+    // its own copy of the text and is flagged.
+    auto check = [](EditorWrapper *wrapper) {
+      uint64_t size, stamp;
+      auto exists = Helper::fileStamp(wrapper->file, size, stamp);
+      if (exists && size == wrapper->diskSize && stamp == wrapper->diskStamp) {
+        return;
+      }
+      
+      if (!wrapper->editor->textChanged && exists && reloadEditor(wrapper)) {
+        return;
+      }
+      wrapper->changedOnDisk = true;
+    };
+    
+    for (auto &change : changes) {
+      if (change.kind == Helper::FileWatcher::Kind::Overflow) {
+        for (auto &[file, wrapper] : editors) {
+          check(wrapper);
+        }
+        break;
+      }
+      
+      auto found = editors.find(change.file.lexically_normal().string());
+      if (found != editors.end()) {
+        check(found->second);
+      }
+    }
+  }
+  
+  void renderFileTree(const Helper::FileTree::Node &directory) {
+    for (auto &node : directory.children) {
+      if (node.isDirectory) {
+        if (ImGui::TreeNode(node.name.c_str())) {
+          renderFileTree(node);
+          ImGui::TreePop();
+        }
+      } else {
+        ImGui::TreeNodeEx(node.name.c_str(),
                           ImGuiTreeNodeFlags_Leaf |
                           ImGuiTreeNodeFlags_NoTreePushOnOpen);
         if (ImGui::IsItemClicked()) {
-          std::thread([entry]() {
-                        std::ifstream ifs(entry.path().c_str(),
-                                          std::ios::in | std::ios::binary | std::ios::ate);
-                        std::ifstream::pos_type fileSize = ifs.tellg();
-                        ifs.seekg(0, std::ios::beg);
-                        
-                        std::vector<char> bytes(fileSize);
-                        ifs.read(bytes.data(), fileSize);
-                        
-                        ifs.close();
-                        
-                        EditorWrapper *wrapper = new EditorWrapper;
-                        EditorUI *newEditor = new EditorUI;
-                        SearchAndReplaceUI *searchAndReplace = new SearchAndReplaceUI;
-                        wrapper->editor = newEditor;
-                        wrapper->name = entry.path().filename().string();
-                        
-                        newEditor->setText(string(bytes.data(), fileSize));
-                        newEditor->setSearchAndReplace(searchAndReplace);
-                        
-                        newEditor->onSave = [entry](const string& text) {
-                          std::ofstream ofs(entry.path().c_str(), std::ios::trunc);
-                          ofs << text;
-                          ofs.close();
-                        };
-                        
-                        g_newEditorMutex.lock();
-                        g_editors.push_back(wrapper);
-                        g_newEditorMutex.unlock();
-                      }).detach();
+          openFile(node.file, -1, 0);
         }
       }
     }
   }
   
-  void renderSlnExplorerRecursive(Project::VSProject *project) {
-    if (project->isFolder) {
-      for (auto &p : project->childs) {
-        if (ImGui::TreeNode(p->name.c_str())) {
-          renderSlnExplorerRecursive(p);
+  void renderSlnExplorerRecursive(Project::ProjectIndex index) {
+    auto &project = g_sln->projects[index];
+    if (project.isFolder) {
+      for (auto child : (*g_sln)[project.childs]) {
+        auto open = ImGui::TreeNode(g_sln->c_str(g_sln->projects[child].name));
+        if (ImGui::IsItemClicked()) {
+          g_currentProject = child;
+        }
+        if (open) {
+          renderSlnExplorerRecursive(child);
           ImGui::TreePop();
         }
       }
     } else {
-      renderSlnExplorerRecursive(project->directory, false);
+      auto &tree = g_fileTrees[index];
+      if (!tree) {
+        tree = std::make_shared<Helper::FileTree>(g_sln->directory(project),
+                                                  g_watcher);
+        tree->build();
+      }
+      if (tree->ready()) {
+        renderFileTree(tree->top);
+      } else {
+        ImGui::TextDisabled("Loading...");
+      }
     }
   }
   
@@ -124,9 +256,17 @@ namespace UI {
     ImGui::SetNextWindowSize(ImVec2(0.f, 0.f), ImGuiCond_FirstUseEver);
     ImGui::Begin("Solution Explorer", &g_renderSolutionExplorer);
     
+    if (g_fileTrees.size() != g_sln->projects.size()) {
+      g_fileTrees.assign(g_sln->projects.size(), nullptr);
+    }
+    
     if (ImGui::TreeNode(g_sln->name.c_str())) {
-      for (auto &project : g_sln->projects) {
-        if (ImGui::TreeNode(project->name.c_str())) {
+      for (auto project : g_sln->roots) {
+        auto open = ImGui::TreeNode(g_sln->c_str(g_sln->projects[project].name));
+        if (ImGui::IsItemClicked()) {
+          g_currentProject = project;
+        }
+        if (open) {
           renderSlnExplorerRecursive(project);
           ImGui::TreePop();
         }
@@ -137,6 +277,190 @@ namespace UI {
     ImGui::End();
   }
   
+  void MainUI::startSolutionSearch(const string& text, const string *replacement) {
+    PROFILE_START;
+    if (g_findAll) {
+      g_findAll->cancel();
+      g_findAll.reset();
+    }
+    g_findResults.clear();
+    g_findRowsStale = true;
+    g_openReplacements = 0;
+    g_openPatched = false;
+    searchAndReplace->searchError.clear();
+    
+    if (text.empty() || !g_sln) {
+      return;
+    }
+    
+    // "Current Project" is the one last clicked in the Solution Explorer.
+    std::vector<Project::ProjectIndex> projects = g_sln->roots;
+    if (searchAndReplace->location == 0 && g_currentProject != Project::NoProject) {
+      projects = {g_currentProject};
+    }
+    
+    auto search = std::make_shared<Text::SolutionSearch>(g_sln, projects, text, searchAndReplace->matchCase,
+                                                         searchAndReplace->useRegex, g_index);
+    if (replacement) {
+      // Open files may have unsaved edits, their editors get patched instead.
+      std::unordered_set<string> openFiles;
+      {
+        std::lock_guard<std::mutex> guard(g_newEditorMutex);
+        for (auto wrapper : g_editors) {
+          if (!wrapper->file.empty()) {
+            openFiles.insert(wrapper->file.lexically_normal().string());
+          }
+        }
+      }
+      search->replaceWith(*replacement, std::move(openFiles));
+      g_openReplacer.compile(text, *replacement, searchAndReplace->matchCase, searchAndReplace->useRegex,
+                             searchAndReplace->searchError);
+    }
+    
+    if (!search->start(searchAndReplace->searchError)) {
+      return;
+    }
+    
+    g_findAll = search;
+    g_renderFindResults = true;
+  }
+  
+  void MainUI::findAll(const string& text) {
+    startSolutionSearch(text, nullptr);
+  }
+  
+  void MainUI::replaceAll(const string& text, const string& replacement) {
+    startSolutionSearch(text, &replacement);
+  }
+  
+  void patchOpenEditors() {
+    std::lock_guard<std::mutex> guard(g_newEditorMutex);
+    for (size_t i = 0; i < g_findResults.size(); i++) {
+      auto &result = g_findResults[i];
+      if (!result.open) {
+        continue;
+      }
+      
+      for (auto wrapper : g_editors) {
+        if (wrapper->file.lexically_normal() == result.file) {
+          result.count = wrapper->editor->replaceMatches(g_openReplacer);
+          g_openReplacements += result.count;
+        }
+      }
+    }
+  }
+  
+  void buildFindRows() {
+    g_findRows.clear();
+    for (size_t i = 0; i < g_findResults.size(); i++) {
+      auto &result = g_findResults[i];
+      // Open files are only counted once their editors are patched.
+      if (result.open && !g_openPatched) {
+        continue;
+      }
+      g_findRows.push_back({(uint32_t)i, -1});
+      if (result.expanded) {
+        for (size_t match = 0; match < result.matches.size(); match++) {
+          g_findRows.push_back({(uint32_t)i, (int32_t)match});
+        }
+      }
+    }
+    g_findRowsResults = g_findResults.size();
+    g_findRowsStale = false;
+  }
+  
+  void renderFindResults() {
+    PROFILE_START;
+    if (g_findAll) {
+      g_findAll->take(g_findResults);
+      if (g_findAll->finished()) {
+        g_findAll->take(g_findResults);
+      }
+      if (g_findAll->replacing && g_findAll->finished() && !g_openPatched) {
+        g_openPatched = true;
+        if (g_findAll->committed()) {
+          patchOpenEditors();
+        }
+        // Every open file of the searched projects is listed, only the ones
+        // something was replaced in are kept.
+        std::erase_if(g_findResults, [](const Text::SolutionSearch::FileResult& result) { return result.count == 0; });
+        g_findRowsStale = true;
+      }
+    }
+    
+    ImGui::SetNextWindowSize(ImVec2(600.f, 300.f), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Find Results", &g_renderFindResults);
+    
+    if (g_findAll && g_findAll->replacing) {
+      if (!g_findAll->finished()) {
+        ImGui::Text("Replacing, %zu files searched...", g_findAll->filesSearched());
+      } else if (g_findAll->committed()) {
+        ImGui::Text("Replaced %zu matches in %zu files in %.2f s, %zu of them in open editors",
+                    g_findAll->matchCount() + g_openReplacements, g_findResults.size(), g_findAll->seconds(),
+                    g_openReplacements);
+      } else if (g_findAll->filesUnrestored() > 0) {
+        ImGui::Text("Replace failed, %zu files could not be put back, their originals are next to them as "
+                    ".backup.replace~", g_findAll->filesUnrestored());
+      } else if (g_findAll->filesFailed() > 0) {
+        ImGui::Text("Replace failed for %zu files, no file was changed", g_findAll->filesFailed());
+      } else {
+        ImGui::Text("Replace cancelled, no file was changed");
+      }
+    } else if (g_findAll) {
+      ImGui::Text(g_findAll->finished() ? "%zu matches in %zu files, %zu files searched, %zu skipped by the index"
+                  : "%zu matches in %zu files, %zu files searched, %zu skipped by the index...",
+                  g_findAll->matchCount(), g_findResults.size(), g_findAll->filesSearched(),
+                  g_findAll->filesSkipped());
+    }
+    if (g_index && !g_index->ready()) {
+      ImGui::Text("Indexing solution...");
+    }
+    
+    if (g_findRowsStale || g_findRowsResults != g_findResults.size()) {
+      buildFindRows();
+    }
+    
+    ImGuiListClipper clipper;
+    clipper.Begin((int)g_findRows.size());
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+        auto &result = g_findResults[g_findRows[row].result];
+        auto index = g_findRows[row].match;
+        ImGui::PushID((int)g_findRows[row].result);
+        if (index >= 0) {
+          auto &match = result.matches[index];
+          ImGui::PushID(index);
+          ImGui::Indent();
+          if (ImGui::Selectable("##match")) {
+            openFile(result.file, match.line, match.column);
+          }
+          ImGui::SameLine();
+          ImGui::Text("%d:%d  %s", match.line + 1, match.column + 1, match.preview.c_str());
+          ImGui::Unindent();
+          ImGui::PopID();
+        } else if (result.matches.empty()) {
+          if (ImGui::Selectable("##file")) {
+            openFile(result.file, -1, 0);
+          }
+          ImGui::SameLine();
+          ImGui::Text("%s (%zu)", result.name.c_str(), result.count);
+        } else {
+          // Matches are rows of their own, the node pushes nothing.
+          ImGui::SetNextItemOpen(result.expanded);
+          auto expanded = ImGui::TreeNodeEx("file", ImGuiTreeNodeFlags_NoTreePushOnOpen, "%s (%zu)",
+                                            result.name.c_str(), result.count);
+          if (expanded != result.expanded) {
+            result.expanded = expanded;
+            g_findRowsStale = true;
+          }
+        }
+        ImGui::PopID();
+      }
+    }
+    
+    ImGui::End();
+  }
+  
   void MainUI::renderMain() {
     PROFILE_START;
     
@@ -172,6 +496,8 @@ namespace UI {
     
     ImGui::End();
     
+    pollFileChanges();
+    
     if (g_renderSolutionExplorer) {
       renderSlnExplorer();
     }
@@ -180,6 +506,10 @@ namespace UI {
       searchAndReplace->render(showSearchAndReplace);
     }
     
+    if (g_renderFindResults) {
+      renderFindResults();
+    }
+    
     if (g_newEditorMutex.try_lock()) {
       for (auto wrapper : g_editors) {
         ImGui::SetNextWindowDockID(mainDockspace, ImGuiCond_FirstUseEver);
@@ -198,12 +528,30 @@ namespace UI {
           wrapper->editor->onKeyPress = [this](const ImGuiIO& io) { this->keyPress(io); };
         }
         
+        if (wrapper->revealLine >= 0) {
+          ImGui::SetNextWindowFocus();
+        }
+        
         ImGui::Begin(wrapper->name.c_str(), nullptr,
                      windowFlags);
         ImGui::PushAllowKeyboardFocus(true);
         
+        if (wrapper->changedOnDisk) {
+          ImGui::TextColored(ImVec4(1.f, .8f, .3f, 1.f), "The file changed on disk.");
+          ImGui::SameLine();
+          if (ImGui::SmallButton("Reload")) {
+            reloadEditor(wrapper);
+          }
+        }
+        
         wrapper->editor->render();
         
+        // After rendering, so the editor knows its line height.
+        if (wrapper->revealLine >= 0) {
+          wrapper->editor->setCursorLine(wrapper->revealLine, wrapper->revealColumn);
+          wrapper->revealLine = -1;
+        }
+        
         ImGui::PopStyleColor();
         ImGui::PopAllowKeyboardFocus();
         
@@ -213,10 +561,20 @@ namespace UI {
     }
   }
   
+  // The index lives in the solution's .vs folder, next to Visual Studio's.
+  // The watcher starts with it, before any file tree or editor needs it.
+  void indexSolution() {
+    auto storage = path(g_sln->path).parent_path() / ".vs" / (g_sln->name + ".trigrams");
+    g_index = std::make_shared<Text::TrigramIndex>(storage);
+    g_index->build(g_sln);
+    g_watcher = Helper::FileWatcher::create();
+  }
+  
   void MainUI::setup(Project::VSSolution *sln) {
     if (sln) {
       g_sln = sln;
       g_renderWelcome = false;
+      indexSolution();
       
       EditorWrapper *wrapper = new EditorWrapper;
       EditorUI *editor = new EditorUI;
@@ -236,6 +594,10 @@ namespace UI {
       g_newEditorMutex.unlock();
       
       searchAndReplace = new SearchAndReplaceUI;
+      searchAndReplace->onFindAll = [this](const string& text) { this->findAll(text); };
+      searchAndReplace->onReplaceAll = [this](const string& text, const string& replacement) {
+        this->replaceAll(text, replacement);
+      };
     }
   }
   
@@ -245,6 +607,7 @@ namespace UI {
       g_sln = UI::WelcomeUI::tryGetSln();
       if (g_sln) {
         g_renderWelcome = false;
+        indexSolution();
         return;
       }
       UI::WelcomeUI::render();
@@ -254,6 +617,14 @@ namespace UI {
   }
   
   void MainUI::shutdown() {
+    if (g_findAll) {
+      g_findAll->cancel();
+    }
+    // Saves made since the build are only in memory.
+    if (g_index && g_index->ready()) {
+      g_index->save();
+    }
+    
     g_newEditorMutex.lock();
     for (auto wrapper : g_editors) {
       delete wrapper->editor->searchAndReplace;
@@ -16,6 +16,9 @@ namespace UI {
     void shutdown();
     void renderMain();
     void keyPress(const ImGuiIO& io);
+    void findAll(const string& text);
+    void replaceAll(const string& text, const string& replacement);
+    void startSolutionSearch(const string& text, const string *replacement);
     
     bool showSearchAndReplace;
     SearchAndReplaceUI* searchAndReplace;
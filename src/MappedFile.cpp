@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+#include "Tooling.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Helper {
+
+MappedFile::~MappedFile() { close(); }
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const path &file) {
+  PROFILE_START;
+  close();
+
+  auto handle = CreateFileW(file.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(handle, &fileSize)) {
+    CloseHandle(handle);
+    return false;
+  }
+
+  // Zero sized mappings are rejected by the API, an empty view is enough.
+  if (fileSize.QuadPart == 0) {
+    CloseHandle(handle);
+    return true;
+  }
+
+  auto mapping =
+      CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(handle);
+  if (!mapping) {
+    return false;
+  }
+
+  // The view keeps the mapping alive on its own.
+  auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view) {
+    return false;
+  }
+
+  data = (const char *)view;
+  size = (size_t)fileSize.QuadPart;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data) {
+    UnmapViewOfFile(data);
+  }
+  data = nullptr;
+  size = 0;
+}
+
+#else
+
+bool MappedFile::open(const path &file) {
+  PROFILE_START;
+  close();
+
+  auto fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  if (info.st_size == 0) {
+    ::close(fd);
+    return true;
+  }
+
+  auto view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+
+  madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+  data = (const char *)view;
+  size = (size_t)info.st_size;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data) {
+    munmap((void *)data, size);
+  }
+  data = nullptr;
+  size = 0;
+}
+
+#endif
+
+} // namespace Helper
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Constants.h"
+#include <cstddef>
+
+namespace Helper {
+
+// Read-only mapping of a whole file. The view stays valid for the lifetime of
+// the object, empty files open successfully with a null view.
+struct MappedFile {
+  MappedFile() : data(nullptr), size(0) {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const path &file);
+  void close();
+
+  const char *data;
+  size_t size;
+};
+
+} // namespace Helper
@@ -0,0 +1,950 @@
+#include "Regex.h"
+#include "Tooling.h"
+#include <algorithm>
+
+namespace Text {
+
+static inline uint8_t foldCase(uint8_t c) {
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static inline bool isWordByte(uint8_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline void addByte(Regex::ByteSet &set, uint8_t c) {
+  set[c >> 6] |= 1ull << (c & 63);
+}
+
+static inline bool hasByte(const Regex::ByteSet &set, uint8_t c) {
+  return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+static void addRange(Regex::ByteSet &set, uint8_t from, uint8_t to) {
+  for (int c = from; c <= to; c++) {
+    addByte(set, (uint8_t)c);
+  }
+}
+
+// Recursive descent over the pattern, building the parse tree bottom up.
+struct RegexParser {
+  using Node = Regex::Node;
+  using Kind = Regex::Node::Kind;
+
+  std::string_view pattern;
+  size_t pos = 0;
+  bool matchCase = true;
+  std::vector<Node> nodes;
+  std::vector<Regex::ByteSet> &classes;
+  int groupCount = 1;
+  // Open groups, each one is a level of recursion.
+  int depth = 0;
+  string error;
+
+  RegexParser(std::string_view pattern, bool matchCase,
+              std::vector<Regex::ByteSet> &classes)
+      : pattern(pattern), matchCase(matchCase), classes(classes) {}
+
+  bool atEnd() const { return pos >= pattern.size(); }
+  char peek() const { return pattern[pos]; }
+
+  int add(Node node) {
+    nodes.push_back(std::move(node));
+    return (int)nodes.size() - 1;
+  }
+
+  int leaf(Kind kind) {
+    Node node;
+    node.kind = kind;
+    return add(std::move(node));
+  }
+
+  int fail(const char *message) {
+    if (error.empty()) {
+      error = string(message) + " at position " + std::to_string(pos);
+    }
+    return -1;
+  }
+
+  int parseAlternation() {
+    auto first = parseConcat();
+    if (first < 0 || atEnd() || peek() != '|') {
+      return first;
+    }
+
+    Node alternate;
+    alternate.kind = Kind::Alternate;
+    alternate.children.push_back(first);
+    while (!atEnd() && peek() == '|') {
+      pos++;
+      auto next = parseConcat();
+      if (next < 0) {
+        return -1;
+      }
+      alternate.children.push_back(next);
+    }
+    return add(std::move(alternate));
+  }
+
+  int parseConcat() {
+    Node concat;
+    concat.kind = Kind::Concat;
+    while (!atEnd() && peek() != '|' && peek() != ')') {
+      auto item = parseRepeat();
+      if (item < 0) {
+        return -1;
+      }
+      concat.children.push_back(item);
+    }
+    return add(std::move(concat));
+  }
+
+  bool parseNumber(int &value) {
+    auto start = pos;
+    value = 0;
+    while (!atEnd() && peek() >= '0' && peek() <= '9') {
+      value = std::min(value * 10 + (peek() - '0'), Regex::MaxRepeat + 1);
+      pos++;
+    }
+    return pos > start;
+  }
+
+  int parseRepeat() {
+    auto atom = parseAtom();
+    if (atom < 0) {
+      return -1;
+    }
+
+    while (!atEnd()) {
+      int min, max;
+      auto c = peek();
+      if (c == '*') {
+        min = 0, max = -1;
+        pos++;
+      } else if (c == '+') {
+        min = 1, max = -1;
+        pos++;
+      } else if (c == '?') {
+        min = 0, max = 1;
+        pos++;
+      } else if (c == '{') {
+        auto start = pos++;
+        if (!parseNumber(min)) {
+          // Not a counted repetition, the brace is a literal.
+          pos = start;
+          break;
+        }
+        max = min;
+        if (!atEnd() && peek() == ',') {
+          pos++;
+          if (!parseNumber(max)) {
+            max = -1;
+          }
+        }
+        if (atEnd() || peek() != '}') {
+          return fail("Unterminated repetition");
+        }
+        pos++;
+        if (min > Regex::MaxRepeat || max > Regex::MaxRepeat) {
+          return fail("Repetition count too large");
+        }
+        if (max >= 0 && max < min) {
+          return fail("Invalid repetition range");
+        }
+      } else {
+        break;
+      }
+
+      if (nodes[atom].kind == Kind::Assert) {
+        return fail("Nothing to repeat");
+      }
+
+      Node repeat;
+      repeat.kind = Kind::Repeat;
+      repeat.min = min;
+      repeat.max = max;
+      if (!atEnd() && peek() == '?') {
+        repeat.greedy = false;
+        pos++;
+      }
+      repeat.children.push_back(atom);
+      atom = add(std::move(repeat));
+    }
+    return atom;
+  }
+
+  int byteNode(uint8_t c) {
+    // Letters become two-byte classes when case does not matter.
+    if (!matchCase && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+      Regex::ByteSet set{};
+      addByte(set, foldCase(c));
+      addByte(set, foldCase(c) & ~0x20);
+      return classNode(set);
+    }
+
+    Node node;
+    node.kind = Kind::Byte;
+    node.byte = c;
+    return add(std::move(node));
+  }
+
+  int classNode(const Regex::ByteSet &set) {
+    Node node;
+    node.kind = Kind::Class;
+    node.cls = (int)classes.size();
+    classes.push_back(set);
+    return add(std::move(node));
+  }
+
+  int assertNode(Regex::Op op) {
+    Node node;
+    node.kind = Kind::Assert;
+    node.assertion = op;
+    return add(std::move(node));
+  }
+
+  // Shorthand classes, shared between atoms and bracket expressions.
+  bool shorthand(char c, Regex::ByteSet &set) {
+    Regex::ByteSet base{};
+    switch (c | 0x20) {
+    case 'd':
+      addRange(base, '0', '9');
+      break;
+    case 'w':
+      addRange(base, 'a', 'z');
+      addRange(base, 'A', 'Z');
+      addRange(base, '0', '9');
+      addByte(base, '_');
+      break;
+    case 's':
+      for (auto s : {' ', '\t', '\n', '\r', '\f', '\v'}) {
+        addByte(base, (uint8_t)s);
+      }
+      break;
+    default:
+      return false;
+    }
+
+    // Upper case letters are the negated forms.
+    auto negate = c >= 'A' && c <= 'Z';
+    for (int i = 0; i < 4; i++) {
+      set[i] |= negate ? ~base[i] : base[i];
+    }
+    return true;
+  }
+
+  bool escapedByte(char c, uint8_t &out) {
+    switch (c) {
+    case 'n':
+      out = '\n';
+      return true;
+    case 't':
+      out = '\t';
+      return true;
+    case 'r':
+      out = '\r';
+      return true;
+    case 'f':
+      out = '\f';
+      return true;
+    case 'v':
+      out = '\v';
+      return true;
+    case '0':
+      out = 0;
+      return true;
+    }
+    // Everything that is not alphanumeric escapes to itself.
+    if (!isWordByte((uint8_t)c) || c == '_') {
+      out = (uint8_t)c;
+      return true;
+    }
+    return false;
+  }
+
+  int parseClass() {
+    Regex::ByteSet set{};
+    auto negate = !atEnd() && peek() == '^';
+    if (negate) {
+      pos++;
+    }
+
+    // A leading ] is a literal.
+    auto first = true;
+    while (!atEnd() && (peek() != ']' || first)) {
+      first = false;
+      uint8_t low;
+      auto c = peek();
+      pos++;
+
+      if (c == '\\') {
+        if (atEnd()) {
+          return fail("Trailing backslash");
+        }
+        auto e = peek();
+        pos++;
+        if (shorthand(e, set)) {
+          continue;
+        }
+        if (!escapedByte(e, low)) {
+          return fail("Unknown escape in class");
+        }
+      } else {
+        low = (uint8_t)c;
+      }
+
+      auto high = low;
+      if (pos + 1 < pattern.size() && peek() == '-' && pattern[pos + 1] != ']') {
+        pos++;
+        auto h = peek();
+        pos++;
+        if (h == '\\') {
+          if (atEnd() || !escapedByte(peek(), high)) {
+            return fail("Invalid range end");
+          }
+          pos++;
+        } else {
+          high = (uint8_t)h;
+        }
+        if (high < low) {
+          return fail("Invalid class range");
+        }
+      }
+      addRange(set, low, high);
+    }
+
+    if (atEnd()) {
+      return fail("Unterminated character class");
+    }
+    pos++;
+
+    if (!matchCase) {
+      for (int c = 'a'; c <= 'z'; c++) {
+        if (hasByte(set, (uint8_t)c) || hasByte(set, (uint8_t)(c & ~0x20))) {
+          addByte(set, (uint8_t)c);
+          addByte(set, (uint8_t)(c & ~0x20));
+        }
+      }
+    }
+
+    if (negate) {
+      for (auto &word : set) {
+        word = ~word;
+      }
+    }
+    return classNode(set);
+  }
+
+  int parseAtom() {
+    auto c = peek();
+    pos++;
+
+    switch (c) {
+    case '.':
+      return leaf(Kind::Any);
+    case '^':
+      return assertNode(Regex::Op::LineStart);
+    case '$':
+      return assertNode(Regex::Op::LineEnd);
+    case '[':
+      return parseClass();
+    case '*':
+    case '+':
+    case '?':
+      pos--;
+      return fail("Nothing to repeat");
+    case '(': {
+      Node group;
+      group.kind = Kind::Group;
+      if (pos + 1 < pattern.size() && peek() == '?' && pattern[pos + 1] == ':') {
+        pos += 2;
+      } else {
+        group.group = groupCount++;
+      }
+
+      if (++depth > Regex::MaxDepth) {
+        return fail("Pattern nested too deeply");
+      }
+      auto inner = parseAlternation();
+      depth--;
+      if (inner < 0) {
+        return -1;
+      }
+      if (atEnd() || peek() != ')') {
+        return fail("Missing )");
+      }
+      pos++;
+      group.children.push_back(inner);
+      return add(std::move(group));
+    }
+    case '\\': {
+      if (atEnd()) {
+        return fail("Trailing backslash");
+      }
+      auto e = peek();
+      pos++;
+
+      if (e == 'b') {
+        return assertNode(Regex::Op::WordBoundary);
+      }
+      if (e == 'B') {
+        return assertNode(Regex::Op::NotWordBoundary);
+      }
+
+      Regex::ByteSet set{};
+      if (shorthand(e, set)) {
+        return classNode(set);
+      }
+
+      uint8_t b;
+      if (!escapedByte(e, b)) {
+        pos--;
+        return fail("Unknown escape");
+      }
+      return byteNode(b);
+    }
+    default:
+      return byteNode((uint8_t)c);
+    }
+  }
+};
+
+// Emits the Thompson construction of the parse tree into a program.
+struct RegexCompiler {
+  using Node = Regex::Node;
+  using Kind = Regex::Node::Kind;
+  using Op = Regex::Op;
+
+  const std::vector<Node> &nodes;
+  std::vector<Regex::Inst> &program;
+
+  // Once past the limit nothing more is compiled, the program is thrown
+  // away anyway.
+  bool tooLarge() const { return program.size() > Regex::MaxProgramSize; }
+
+  int emit(Op op, int x = 0, int y = 0, uint8_t byte = 0) {
+    program.push_back({op, byte, x, y});
+    return (int)program.size() - 1;
+  }
+
+  void compile(int index) {
+    if (tooLarge()) {
+      return;
+    }
+    auto &node = nodes[index];
+    switch (node.kind) {
+    case Kind::Empty:
+      break;
+    case Kind::Byte:
+      emit(Op::Byte, 0, 0, node.byte);
+      break;
+    case Kind::Class:
+      emit(Op::Class, node.cls);
+      break;
+    case Kind::Any:
+      emit(Op::Any);
+      break;
+    case Kind::Assert:
+      emit(node.assertion);
+      break;
+    case Kind::Concat:
+      for (auto child : node.children) {
+        compile(child);
+      }
+      break;
+    case Kind::Group:
+      if (node.group >= 0) {
+        emit(Op::Save, node.group * 2);
+      }
+      compile(node.children[0]);
+      if (node.group >= 0) {
+        emit(Op::Save, node.group * 2 + 1);
+      }
+      break;
+    case Kind::Alternate: {
+      std::vector<int> jumps;
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (i + 1 == node.children.size()) {
+          compile(node.children[i]);
+          break;
+        }
+        auto split = emit(Op::Split);
+        program[split].x = split + 1;
+        compile(node.children[i]);
+        jumps.push_back(emit(Op::Jump));
+        program[split].y = (int)program.size();
+      }
+      for (auto jump : jumps) {
+        program[jump].x = (int)program.size();
+      }
+      break;
+    }
+    case Kind::Repeat:
+      compileRepeat(node);
+      break;
+    }
+  }
+
+  // Splits prefer their first branch, so greedy repetitions put the body
+  // first and lazy ones the exit.
+  void setSplit(int split, int body, int exit, bool greedy) {
+    program[split].x = greedy ? body : exit;
+    program[split].y = greedy ? exit : body;
+  }
+
+  void compileRepeat(const Node &node) {
+    auto child = node.children[0];
+    for (int i = 0; i < node.min && !tooLarge(); i++) {
+      compile(child);
+    }
+
+    if (node.max < 0) {
+      // x*: L: split body, exit; body; jump L
+      auto split = emit(Op::Split);
+      compile(child);
+      emit(Op::Jump, split);
+      setSplit(split, split + 1, (int)program.size(), node.greedy);
+      return;
+    }
+
+    // x{0,n}: every optional copy can give up and leave the whole loop.
+    std::vector<int> splits;
+    for (int i = node.min; i < node.max && !tooLarge(); i++) {
+      splits.push_back(emit(Op::Split));
+      compile(child);
+    }
+    for (auto split : splits) {
+      setSplit(split, split + 1, (int)program.size(), node.greedy);
+    }
+  }
+};
+
+// Leading literal of the tree, looking through groups and assertions.
+static void literalPrefix(const std::vector<Regex::Node> &nodes, int index,
+                          string &prefix, bool &open) {
+  using Kind = Regex::Node::Kind;
+  auto &node = nodes[index];
+  switch (node.kind) {
+  case Kind::Byte:
+    prefix.push_back((char)node.byte);
+    break;
+  case Kind::Assert:
+    break;
+  case Kind::Group:
+    literalPrefix(nodes, node.children[0], prefix, open);
+    break;
+  case Kind::Concat:
+    for (auto child : node.children) {
+      literalPrefix(nodes, child, prefix, open);
+      if (!open) {
+        break;
+      }
+    }
+    break;
+  default:
+    open = false;
+    break;
+  }
+}
+
+bool Regex::compile(std::string_view pattern, bool matchCase, string &error) {
+  PROFILE_START;
+  this->matchCase = matchCase;
+  program.clear();
+  classes.clear();
+  prefix.clear();
+  prefixSearcher.reset();
+
+  RegexParser parser(pattern, matchCase, classes);
+  int root = pattern.empty() ? -1 : parser.parseAlternation();
+  if (root >= 0 && !parser.atEnd()) {
+    root = parser.fail("Unmatched )");
+  }
+  if (root < 0) {
+    error = pattern.empty() ? "Empty pattern" : parser.error;
+    return false;
+  }
+  groupCount = parser.groupCount;
+
+  // Stacked repetitions such as a*** nest without groups, so the depth of
+  // the tree is checked before compiling it recursively. Children always
+  // come before their parents.
+  std::vector<int> depths(parser.nodes.size(), 1);
+  for (size_t i = 0; i < parser.nodes.size(); i++) {
+    for (auto child : parser.nodes[i].children) {
+      depths[i] = std::max(depths[i], depths[child] + 1);
+    }
+    if (depths[i] > MaxDepth) {
+      error = "Pattern nested too deeply";
+      return false;
+    }
+  }
+
+  RegexCompiler compiler{parser.nodes, program};
+  compiler.emit(Op::Save, 0);
+  compiler.compile(root);
+  compiler.emit(Op::Save, 1);
+  compiler.emit(Op::Match);
+  if (compiler.tooLarge()) {
+    program.clear();
+    classes.clear();
+    error = "Pattern too large";
+    return false;
+  }
+
+  // Case-insensitive letters are classes, so the prefix stops at the first
+  // one and stays exact.
+  bool open = true;
+  literalPrefix(parser.nodes, root, prefix, open);
+  if (!prefix.empty()) {
+    prefixSearcher = std::make_unique<Searcher>(prefix, true);
+  }
+  return true;
+}
+
+// One list of threads per text position. Every program counter shows up at
+// most once and owns a fixed slice of the capture storage.
+struct RegexThreads {
+  std::vector<int> pcs;
+  std::vector<uint32_t> marks;
+  uint32_t generation = 0;
+  std::vector<size_t> captures;
+  // The search each thread belongs to, see RegexVM.
+  std::vector<size_t> levels;
+
+  void reset(size_t programSize, size_t slots) {
+    pcs.clear();
+    pcs.reserve(programSize);
+    marks.assign(programSize, 0);
+    generation = 1;
+    captures.resize(programSize * slots);
+    levels.resize(programSize);
+  }
+
+  void clear() { cut(0); }
+
+  // Drops the threads from end on, their program counters may be added
+  // again.
+  void cut(size_t end) {
+    pcs.resize(end);
+    // Wrapping around would make stale marks look current.
+    if (++generation == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      generation = 1;
+    }
+    for (auto pc : pcs) {
+      marks[pc] = generation;
+    }
+  }
+};
+
+// Finds every match in one pass over the text. A match is only final once
+// no thread of higher priority is left, which may be far behind its end, so
+// the search for the next match starts at its end right away. Those
+// searches are levels, kept in order, each behind the match found by the
+// one before it. A thread only ever runs for the first level reaching its
+// program counter: if that one dies, so would the copy, and if it matches,
+// every level behind it is dropped anyway. So a text position costs at most
+// a couple of passes over the program however many matches are pending.
+struct RegexVM {
+  const Regex &regex;
+  std::string_view text;
+  size_t slots;
+  RegexThreads current;
+  RegexThreads next;
+  std::vector<size_t> scratch;
+
+  struct Pending {
+    int pc;
+    size_t slot;
+    size_t value;
+  };
+  std::vector<Pending> stack;
+
+  struct Level {
+    size_t start;
+    bool found;
+  };
+  // Levels before done are reported, firstLevel is the id of levels[0].
+  std::vector<Level> levels;
+  std::vector<size_t> found;
+  size_t firstLevel = 0;
+  size_t done = 0;
+  const std::atomic<bool> *cancelled = nullptr;
+
+  // Only the first slots captures are tracked, two is enough for bounds.
+  RegexVM(const Regex &regex, std::string_view text, size_t slots)
+      : regex(regex), text(text), slots(slots) {
+    current.reset(regex.program.size(), slots);
+    next.reset(regex.program.size(), slots);
+    scratch.resize(slots);
+  }
+
+  bool wordBefore(size_t pos) const {
+    return pos > 0 && isWordByte((uint8_t)text[pos - 1]);
+  }
+
+  bool wordAt(size_t pos) const {
+    return pos < text.size() && isWordByte((uint8_t)text[pos]);
+  }
+
+  // Follows everything that does not consume a byte, in priority order. A
+  // chain of those can be as long as the program, so it is walked with a
+  // stack of its own; entries with a negative pc put a capture back.
+  void add(RegexThreads &list, int start, size_t pos, size_t *caps,
+           size_t level) {
+    stack.clear();
+    stack.push_back({start, 0, 0});
+    while (!stack.empty()) {
+      auto entry = stack.back();
+      stack.pop_back();
+      if (entry.pc < 0) {
+        caps[entry.slot] = entry.value;
+        continue;
+      }
+
+      auto pc = entry.pc;
+      if (list.marks[pc] == list.generation) {
+        continue;
+      }
+      list.marks[pc] = list.generation;
+
+      auto &inst = regex.program[pc];
+      switch (inst.op) {
+      case Regex::Op::Jump:
+        stack.push_back({inst.x, 0, 0});
+        break;
+      case Regex::Op::Split:
+        // The first branch goes on top so it is followed first.
+        stack.push_back({inst.y, 0, 0});
+        stack.push_back({inst.x, 0, 0});
+        break;
+      case Regex::Op::Save:
+        if ((size_t)inst.x < slots) {
+          stack.push_back({-1, (size_t)inst.x, caps[inst.x]});
+          caps[inst.x] = pos;
+        }
+        stack.push_back({pc + 1, 0, 0});
+        break;
+      case Regex::Op::LineStart:
+        if (pos == 0 || text[pos - 1] == '\n') {
+          stack.push_back({pc + 1, 0, 0});
+        }
+        break;
+      case Regex::Op::LineEnd:
+        if (pos == text.size() || text[pos] == '\n') {
+          stack.push_back({pc + 1, 0, 0});
+        }
+        break;
+      case Regex::Op::WordBoundary:
+        if (wordBefore(pos) != wordAt(pos)) {
+          stack.push_back({pc + 1, 0, 0});
+        }
+        break;
+      case Regex::Op::NotWordBoundary:
+        if (wordBefore(pos) == wordAt(pos)) {
+          stack.push_back({pc + 1, 0, 0});
+        }
+        break;
+      default:
+        list.pcs.push_back(pc);
+        list.levels[pc] = level;
+        std::copy(caps, caps + slots, list.captures.begin() + pc * slots);
+        break;
+      }
+    }
+  }
+
+  bool consumes(const Regex::Inst &inst, uint8_t c) const {
+    switch (inst.op) {
+    case Regex::Op::Byte:
+      return c == inst.byte;
+    case Regex::Op::Class:
+      return hasByte(regex.classes[inst.x], c);
+    case Regex::Op::Any:
+      return c != '\n';
+    default:
+      return false;
+    }
+  }
+
+  void startLevel(size_t start) {
+    levels.push_back({start, false});
+    found.resize(levels.size() * slots);
+  }
+
+  // A new thread for the last level, the one still looking for a match.
+  void addStart(size_t pos) {
+    std::fill(scratch.begin(), scratch.end(), Regex::npos);
+    add(current, 0, pos, scratch.data(), firstLevel + levels.size() - 1);
+  }
+
+  // Reports the matches no thread can replace any more, in order. Returns
+  // false once report does.
+  template <typename Report> bool settle(size_t alive, Report &report) {
+    while (done < levels.size() && levels[done].found &&
+           firstLevel + done < alive) {
+      auto caps = found.data() + done * slots;
+      done++;
+      if (!report(caps)) {
+        return false;
+      }
+    }
+    // Usually only the level still searching is left.
+    if (done > 0 && done + 1 == levels.size()) {
+      levels.front() = levels.back();
+      levels.resize(1);
+      found.resize(slots);
+      firstLevel += done;
+      done = 0;
+    }
+    return true;
+  }
+
+  // Calls report with the captures of every match starting at or after
+  // from, leftmost-first and not overlapping, until it returns false. After
+  // an empty match the next one starts a byte further.
+  template <typename Report> void run(size_t from, Report report) {
+    levels.clear();
+    firstLevel = 0;
+    done = 0;
+    startLevel(from);
+    current.clear();
+
+    for (auto pos = from; pos <= text.size(); pos++) {
+      if (cancelled && (pos & 0xffff) == 0 && cancelled->load()) {
+        return;
+      }
+      auto start = levels.back().start;
+      if (current.pcs.empty()) {
+        // Nothing in flight, so no match can start before the next
+        // occurrence of the literal prefix.
+        current.clear();
+        pos = std::max(pos, start);
+        if (regex.prefixSearcher && pos < text.size()) {
+          pos = regex.prefixSearcher->find(text.data(), text.size(), pos);
+        }
+        if (pos > text.size()) {
+          break;
+        }
+      }
+      if (pos >= start) {
+        addStart(pos);
+      }
+
+      next.clear();
+      for (size_t i = 0; i < current.pcs.size(); i++) {
+        auto pc = current.pcs[i];
+        auto &inst = regex.program[pc];
+        auto caps = current.captures.data() + pc * slots;
+        auto level = current.levels[pc];
+
+        if (inst.op == Regex::Op::Match) {
+          // Everything after this thread has lower priority, the levels
+          // behind this one included. Their program counters are free
+          // again for the level that now starts behind this match, which
+          // continues at i.
+          current.cut(i--);
+          levels.resize(level - firstLevel + 1);
+          levels.back().found = true;
+          std::copy(caps, caps + slots,
+                    found.begin() + (level - firstLevel) * slots);
+
+          auto nextStart = caps[1] > caps[0] ? caps[1] : caps[1] + 1;
+          startLevel(nextStart);
+          if (nextStart == pos) {
+            addStart(pos);
+          }
+          continue;
+        }
+
+        if (pos < text.size() && consumes(inst, (uint8_t)text[pos])) {
+          add(next, pc + 1, pos + 1, caps, level);
+        }
+      }
+      std::swap(current, next);
+
+      auto alive = current.pcs.empty() ? Regex::npos
+                                       : current.levels[current.pcs[0]];
+      if (!settle(alive, report)) {
+        return;
+      }
+    }
+    settle(Regex::npos, report);
+  }
+};
+
+bool Regex::find(std::string_view text, size_t from,
+                 std::vector<size_t> &groups) const {
+  if (program.empty() || from > text.size()) {
+    return false;
+  }
+  RegexVM vm(*this, text, (size_t)groupCount * 2);
+  auto matched = false;
+  vm.run(from, [&](const size_t *caps) {
+    groups.assign(caps, caps + vm.slots);
+    matched = true;
+    return false;
+  });
+  return matched;
+}
+
+void Regex::findAll(std::string_view text, std::vector<size_t> &ranges,
+                    const std::atomic<bool> *cancelled) const {
+  PROFILE_START;
+  if (program.empty()) {
+    return;
+  }
+  RegexVM vm(*this, text, 2);
+  vm.cancelled = cancelled;
+  vm.run(0, [&](const size_t *caps) {
+    if (caps[1] > caps[0]) {
+      ranges.push_back(caps[0]);
+      ranges.push_back(caps[1]);
+    }
+    return true;
+  });
+}
+
+void Regex::findAllGroups(std::string_view text,
+                          std::vector<size_t> &matches) const {
+  PROFILE_START;
+  if (program.empty()) {
+    return;
+  }
+  RegexVM vm(*this, text, (size_t)groupCount * 2);
+  vm.run(0, [&](const size_t *caps) {
+    matches.insert(matches.end(), caps, caps + vm.slots);
+    return true;
+  });
+}
+
+void Regex::expand(std::string_view replacement, std::string_view text,
+                   const std::vector<size_t> &groups, string &out) const {
+  for (size_t i = 0; i < replacement.size(); i++) {
+    auto c = replacement[i];
+    if (c != '$' || i + 1 >= replacement.size()) {
+      out.push_back(c);
+      continue;
+    }
+
+    auto n = replacement[i + 1];
+    if (n == '$') {
+      out.push_back('$');
+      i++;
+    } else if (n >= '0' && n <= '9') {
+      auto group = (size_t)(n - '0');
+      if (group * 2 + 1 < groups.size() && groups[group * 2] != npos &&
+          groups[group * 2 + 1] != npos) {
+        out.append(text.substr(groups[group * 2],
+                               groups[group * 2 + 1] - groups[group * 2]));
+      }
+      i++;
+    } else {
+      out.push_back(c);
+    }
+  }
+}
+
+} // namespace Text
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Constants.h"
+#include "TextSearch.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace Text {
+
+// Regular expressions compiled to a Thompson NFA and run as a Pike VM, which
+// tracks every alternative at once and so stays linear in the text no matter
+// the pattern, also when finding all matches. Matches are leftmost-first like
+// Perl's. When every match has
+// to begin with the same literal, the Searcher skips ahead to it whenever no
+// match is in progress.
+//
+// Supported: literals, ., [...] and [^...] classes, \d \w \s and their
+// negations, ^ and $ (per line), \b \B, ( ) (?: ), |, * + ? {n} {n,} {n,m}
+// and their lazy forms. Without matchCase ASCII letters are folded.
+struct Regex {
+  Regex() : groupCount(0), matchCase(true) {}
+
+  enum class Op : uint8_t {
+    Byte,
+    Class,
+    Any,
+    Split,
+    Jump,
+    Save,
+    LineStart,
+    LineEnd,
+    WordBoundary,
+    NotWordBoundary,
+    Match
+  };
+
+  struct Inst {
+    Op op;
+    uint8_t byte;
+    // Jump target, first Split branch, class index or save slot.
+    int x;
+    // Second Split branch, taken with lower priority.
+    int y;
+  };
+
+  // Parse tree, only kept while compiling.
+  struct Node {
+    enum class Kind : uint8_t {
+      Empty,
+      Byte,
+      Class,
+      Any,
+      Concat,
+      Alternate,
+      Repeat,
+      Group,
+      Assert
+    };
+    Kind kind;
+    uint8_t byte = 0;
+    Op assertion = Op::Match;
+    int cls = -1;
+    int group = -1;
+    int min = 0;
+    int max = 0;
+    bool greedy = true;
+    std::vector<int> children;
+  };
+
+  using ByteSet = std::array<uint64_t, 4>;
+
+  // Counted repetitions beyond this are rejected. Nested ones still multiply,
+  // so patterns compiling to more than MaxProgramSize instructions are
+  // rejected too, as are ones nested deeper than MaxDepth.
+  static constexpr int MaxRepeat = 1000;
+  static constexpr size_t MaxProgramSize = 100000;
+  static constexpr int MaxDepth = 250;
+
+  // Returns false and describes the problem in error if pattern is invalid.
+  bool compile(std::string_view pattern, bool matchCase, string &error);
+
+  // Finds the leftmost match starting at or after from. groups receives a
+  // start and end offset per group, group 0 being the whole match, and npos
+  // for groups that did not take part.
+  bool find(std::string_view text, size_t from,
+            std::vector<size_t> &groups) const;
+  // Appends start and end of every non-empty, non-overlapping match. Setting
+  // cancelled stops the search early with the matches found so far.
+  void findAll(std::string_view text, std::vector<size_t> &ranges,
+               const std::atomic<bool> *cancelled = nullptr) const;
+  // Every match as find fills groups, empty ones included. As in
+  // JavaScript, the search goes on at the end of a match, or a byte further
+  // if it was empty.
+  void findAllGroups(std::string_view text, std::vector<size_t> &matches) const;
+  // Appends replacement to out with $0-$9 taken from the match and $$ as a
+  // single dollar sign.
+  void expand(std::string_view replacement, std::string_view text,
+              const std::vector<size_t> &groups, string &out) const;
+
+  static constexpr size_t npos = (size_t)-1;
+
+  int groupCount;
+  bool matchCase;
+  std::vector<Inst> program;
+  std::vector<ByteSet> classes;
+  // Literal every match starts with, empty if there is none.
+  string prefix;
+  std::unique_ptr<Searcher> prefixSearcher;
+};
+
+} // namespace Text
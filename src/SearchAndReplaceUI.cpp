@@ -41,13 +41,27 @@ namespace UI {
         showCalled = false;
       }
       
-      ImGui::InputText("Search", &searchText);
+      if (ImGui::InputText("Search", &searchText) && onSearchChanged) {
+        onSearchChanged(searchText);
+      }
       ImGui::InputText("Replace", &replaceText);
       
       if (!editorMode) {
         ImGui::Combo("Search Location", &location, searchLocationText, IM_ARRAYSIZE(searchLocationText));
       }
-      ImGui::Checkbox("Match Case", &matchCase);
+      if (ImGui::Checkbox("Match Case", &matchCase) && onSearchChanged) {
+        onSearchChanged(searchText);
+      }
+      ImGui::SameLine();
+      if (ImGui::Checkbox("Regular Expression", &useRegex) && onSearchChanged) {
+        onSearchChanged(searchText);
+      }
+      
+      if (!searchError.empty()) {
+        ImGui::Text("%s", searchError.c_str());
+      } else if (editorMode && matchCount >= 0) {
+        ImGui::Text(searching ? "%d matches, searching..." : "%d matches", matchCount);
+      }
       
       if (editorMode) {
         if (ImGui::Button("Find Previous")) {
@@ -65,6 +79,9 @@ namespace UI {
         }
       } else {
         if (ImGui::Button("Find All")) {
+          if (onFindAll) {
+            onFindAll(searchText);
+          }
         }
       }
       
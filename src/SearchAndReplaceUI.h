@@ -10,6 +10,7 @@ namespace UI {
     location(0),
     showCalled(false),
     matchCase(false),
+    useRegex(false),
     editorMode(false) {}
     
     void show();
@@ -22,9 +23,17 @@ namespace UI {
     int location;
     bool showCalled;
     bool matchCase;
+    bool useRegex;
     bool editorMode;
+    // Live state of the editor's search, a negative count hides it.
+    int matchCount = -1;
+    bool searching = false;
+    // Why the pattern did not compile, empty if it did.
+    string searchError;
     std::function<void(const string)> onFindNext;
     std::function<void(const string)> onFindPrev;
+    std::function<void(const string)> onFindAll;
     std::function<void(const string, const string)> onReplaceAll;
+    std::function<void(const string)> onSearchChanged;
   };
 }  // namespace UI
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "SearchJob.h"
+#include "Tooling.h"
+#include <algorithm>
+
+namespace Text {
+
+SearchJob::SearchJob(TextBuffer::Snapshot snapshot, std::string_view pattern,
+                     bool matchCase, size_t start)
+    : snapshot(std::move(snapshot)), searcher(pattern, matchCase),
+      useRegex(false), start(start), firstHit(0), hasFirstHit(false),
+      cancelled(false), done(false), found(0) {
+  worker = std::thread([this]() { run(); });
+}
+
+SearchJob::SearchJob(TextBuffer::Snapshot snapshot, Regex regex, size_t start)
+    : snapshot(std::move(snapshot)), searcher("", true),
+      regex(std::move(regex)), useRegex(true), start(start), firstHit(0),
+      hasFirstHit(false), cancelled(false), done(false), found(0) {
+  worker = std::thread([this]() { runRegex(); });
+}
+
+SearchJob::~SearchJob() {
+  cancel();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void SearchJob::cancel() { cancelled = true; }
+
+void SearchJob::take(std::vector<size_t> &after, std::vector<size_t> &before,
+                     std::vector<size_t> &afterEnds,
+                     std::vector<size_t> &beforeEnds) {
+  std::lock_guard<std::mutex> guard(lock);
+  after.swap(pendingAfter);
+  before.swap(pendingBefore);
+  afterEnds.swap(pendingAfterEnds);
+  beforeEnds.swap(pendingBeforeEnds);
+  pendingAfter.clear();
+  pendingBefore.clear();
+  pendingAfterEnds.clear();
+  pendingBeforeEnds.clear();
+}
+
+void SearchJob::run() {
+  PROFILE_START;
+  auto size = snapshot.size;
+  start = std::min(start, size);
+  if (searcher.empty() || !scan(start, size, size, false)) {
+    done = true;
+    return;
+  }
+
+  // Matches starting in front of start may reach past it, but not into the
+  // first match found after it.
+  auto end = std::min(size, start + searcher.size() - 1);
+  if (hasFirstHit) {
+    end = std::min(end, firstHit);
+  }
+  scan(0, end, start, true);
+  done = true;
+}
+
+void SearchJob::runRegex() {
+  PROFILE_START;
+  // Matches may cross pieces, so those get copied together here rather
+  // than on the UI thread.
+  string joined;
+  std::string_view text;
+  if (snapshot.spans.size() == 1) {
+    text = snapshot.spans[0];
+  } else {
+    joined.reserve(snapshot.size);
+    for (auto span : snapshot.spans) {
+      joined.append(span);
+    }
+    text = joined;
+  }
+
+  std::vector<size_t> ranges;
+  regex.findAll(text, ranges, &cancelled);
+  if (cancelled) {
+    done = true;
+    return;
+  }
+
+  start = std::min(start, text.size());
+  std::lock_guard<std::mutex> guard(lock);
+  for (size_t i = 0; i < ranges.size(); i += 2) {
+    auto wrapped = ranges[i] < start;
+    (wrapped ? pendingBefore : pendingAfter).push_back(ranges[i]);
+    (wrapped ? pendingBeforeEnds : pendingAfterEnds).push_back(ranges[i + 1]);
+  }
+  found = ranges.size() / 2;
+  done = true;
+}
+
+bool SearchJob::scan(size_t from, size_t to, size_t limit, bool wrapped) {
+  std::vector<size_t> hits;
+  auto m = searcher.size();
+
+  auto pos = from;
+  while (pos < to && pos < limit) {
+    if (cancelled) {
+      return false;
+    }
+
+    // Each block also looks m - 1 bytes past its end for matches starting
+    // inside it.
+    auto blockEnd = std::min(std::min(to, limit), pos + BlockSize);
+    auto searchEnd = std::min(to, blockEnd + m - 1);
+
+    hits.clear();
+    searcher.findAll(snapshot.spans, pos, searchEnd, hits);
+    auto kept = std::lower_bound(hits.begin(), hits.end(), blockEnd);
+    hits.erase(kept, hits.end());
+
+    pos = blockEnd;
+    if (!hits.empty()) {
+      pos = std::max(pos, hits.back() + m);
+
+      if (!wrapped && !hasFirstHit) {
+        firstHit = hits.front();
+        hasFirstHit = true;
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      auto &pending = wrapped ? pendingBefore : pendingAfter;
+      pending.insert(pending.end(), hits.begin(), hits.end());
+      found += hits.size();
+    }
+  }
+  return true;
+}
+
+} // namespace Text
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Regex.h"
+#include "TextBuffer.h"
+#include "TextSearch.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Text {
+
+// Searches a snapshot of a buffer on a worker thread. Everything from start
+// to the end of the text is searched first, then the part in front of it, so
+// the matches nearest to start show up before the rest. Hits are handed over
+// in batches as the scan goes and destroying the job cancels it.
+//
+// A regex is run over the whole text at once, since its matches can't be
+// cut into blocks, and its hits come with their ends.
+struct SearchJob {
+  SearchJob(TextBuffer::Snapshot snapshot, std::string_view pattern,
+            bool matchCase, size_t start);
+  SearchJob(TextBuffer::Snapshot snapshot, Regex regex, size_t start);
+  ~SearchJob();
+
+  SearchJob(const SearchJob &) = delete;
+  SearchJob &operator=(const SearchJob &) = delete;
+
+  // Bytes searched between two looks at the cancel flag.
+  static constexpr size_t BlockSize = 1 << 20;
+
+  void cancel();
+  // Moves the hits found since the last call out. Both lists are in text
+  // order, every hit in before lies in front of every hit in after. The ends
+  // are only filled for a regex.
+  void take(std::vector<size_t> &after, std::vector<size_t> &before,
+            std::vector<size_t> &afterEnds, std::vector<size_t> &beforeEnds);
+  bool finished() const { return done.load(); }
+  size_t count() const { return found.load(); }
+  size_t patternSize() const { return searcher.size(); }
+
+  void run();
+  bool scan(size_t from, size_t to, size_t limit, bool wrapped);
+  void runRegex();
+
+  TextBuffer::Snapshot snapshot;
+  Searcher searcher;
+  Regex regex;
+  bool useRegex;
+  size_t start;
+  // Only touched by the worker.
+  size_t firstHit;
+  bool hasFirstHit;
+
+  std::mutex lock;
+  std::vector<size_t> pendingAfter;
+  std::vector<size_t> pendingBefore;
+  std::vector<size_t> pendingAfterEnds;
+  std::vector<size_t> pendingBeforeEnds;
+  std::atomic<bool> cancelled;
+  std::atomic<bool> done;
+  std::atomic<size_t> found;
+  std::thread worker;
+};
+
+} // namespace Text
@@ -0,0 +1,215 @@
+#include "SolutionCache.h"
+#include "MappedFile.h"
+#include "StorageFile.h"
+#include "StringInterner.h"
+#include "Tooling.h"
+
+namespace Helper {
+
+// Every range of a project, in the order they are stored.
+static constexpr Project::IndexRange Project::VSProject::*ranges[] = {
+    &Project::VSProject::childs,   &Project::VSProject::projectReferences,
+    &Project::VSProject::references, &Project::VSProject::compiles,
+    &Project::VSProject::nones,    &Project::VSProject::contents,
+    &Project::VSProject::pages,    &Project::VSProject::packageReferences};
+
+bool SolutionCache::load() {
+  PROFILE_START;
+  MappedFile file;
+  if (!file.open(storage) || file.size == 0) {
+    return false;
+  }
+
+  VarintReader reader{(const unsigned char *)file.data,
+                      (const unsigned char *)file.data + file.size};
+  if (reader.next() != Magic || reader.next() != Version) {
+    return false;
+  }
+
+  Project::VSSolution loaded;
+  sln.size = reader.next();
+  sln.stamp = reader.next();
+
+  auto &interner = StringInterner::shared();
+  auto stringCount = reader.next();
+  std::vector<Project::StringIndex> strings;
+  string text;
+  for (uint64_t i = 0; i < stringCount && reader.ok; i++) {
+    if (reader.bytes(reader.next(), text)) {
+      strings.push_back(interner.intern(text));
+    }
+  }
+
+  auto stringIndex = [&]() {
+    auto value = reader.next();
+    if (value >= strings.size()) {
+      reader.ok = false;
+      return Project::StringIndex(0);
+    }
+    return strings[value];
+  };
+
+  // Project indices may point forward, they are checked once all are read.
+  auto projectCount = reader.next();
+  std::vector<ProjectStamp> loadedStamps;
+  for (uint64_t i = 0; i < projectCount && reader.ok; i++) {
+    auto &project = loaded.projects.emplace_back();
+    project.name = stringIndex();
+    project.path = stringIndex();
+    project.id = stringIndex();
+    project.typeId = stringIndex();
+    project.isFolder = reader.next() != 0;
+    auto &stamp = loadedStamps.emplace_back();
+    stamp.file.size = reader.next();
+    stamp.file.stamp = reader.next();
+    auto directoryCount = reader.next();
+    for (uint64_t j = 0; j < directoryCount && reader.ok; j++) {
+      auto directory = stringIndex();
+      stamp.directories.push_back({directory, reader.next()});
+    }
+
+    for (size_t range = 0; range < std::size(ranges) && reader.ok; range++) {
+      auto first = (uint32_t)loaded.indices.size();
+      auto count = reader.next();
+      for (uint64_t j = 0; j < count && reader.ok; j++) {
+        if (range < 2) {
+          auto index = reader.next();
+          reader.ok = reader.ok && index < projectCount;
+          loaded.indices.push_back((uint32_t)index);
+        } else {
+          loaded.indices.push_back(stringIndex());
+        }
+      }
+      project.*ranges[range] = {first, (uint32_t)loaded.indices.size() - first};
+    }
+  }
+
+  auto rootCount = reader.next();
+  for (uint64_t i = 0; i < rootCount && reader.ok; i++) {
+    auto root = reader.next();
+    reader.ok = reader.ok && root < projectCount;
+    loaded.roots.push_back((Project::ProjectIndex)root);
+  }
+
+  if (!reader.ok) {
+    return false;
+  }
+
+  snapshot = std::move(loaded);
+  stamps = std::move(loadedStamps);
+  byPath.clear();
+  for (Project::ProjectIndex i = 0; i < snapshot.projects.size(); i++) {
+    if (!snapshot.projects[i].isFolder) {
+      byPath[snapshot.projects[i].path] = i;
+    }
+  }
+  return true;
+}
+
+bool SolutionCache::save(const Project::VSSolution &solution, Stamp slnFile,
+                         const std::vector<ProjectStamp> &projectFiles) {
+  PROFILE_START;
+  // Only the strings the solution uses are stored, numbered as they come.
+  string table;
+  uint32_t stringCount = 0;
+  std::unordered_map<Project::StringIndex, uint32_t> numbers;
+  auto number = [&](Project::StringIndex index) {
+    auto inserted = numbers.emplace(index, stringCount);
+    if (inserted.second) {
+      auto text = solution.text(index);
+      writeVarint(table, text.size());
+      table.append(text);
+      stringCount++;
+    }
+    return inserted.first->second;
+  };
+
+  string body;
+  writeVarint(body, solution.projects.size());
+  for (size_t i = 0; i < solution.projects.size(); i++) {
+    auto &project = solution.projects[i];
+    writeVarint(body, number(project.name));
+    writeVarint(body, number(project.path));
+    writeVarint(body, number(project.id));
+    writeVarint(body, number(project.typeId));
+    writeVarint(body, project.isFolder);
+    auto stamp = i < projectFiles.size() ? &projectFiles[i] : nullptr;
+    writeVarint(body, stamp ? stamp->file.size : 0);
+    writeVarint(body, stamp ? stamp->file.stamp : 0);
+    writeVarint(body, stamp ? stamp->directories.size() : 0);
+    for (size_t j = 0; stamp && j < stamp->directories.size(); j++) {
+      writeVarint(body, number(stamp->directories[j].path));
+      writeVarint(body, stamp->directories[j].stamp);
+    }
+
+    for (size_t range = 0; range < std::size(ranges); range++) {
+      auto indices = solution[project.*ranges[range]];
+      writeVarint(body, indices.size());
+      for (auto index : indices) {
+        writeVarint(body, range < 2 ? index : number(index));
+      }
+    }
+  }
+
+  writeVarint(body, solution.roots.size());
+  for (auto root : solution.roots) {
+    writeVarint(body, root);
+  }
+
+  string out;
+  writeVarint(out, Magic);
+  writeVarint(out, Version);
+  writeVarint(out, slnFile.size);
+  writeVarint(out, slnFile.stamp);
+  writeVarint(out, stringCount);
+  out.append(table);
+  out.append(body);
+  return replaceFile(storage, out);
+}
+
+Project::VSSolution *SolutionCache::solution(const string &slnFile,
+                                             Stamp stamp) {
+  PROFILE_START;
+  if (snapshot.projects.empty() || !(stamp == sln)) {
+    return nullptr;
+  }
+
+  for (size_t i = 0; i < snapshot.projects.size(); i++) {
+    Stamp current;
+    if (!snapshot.projects[i].isFolder &&
+        (!fileStamp(snapshot.c_str(snapshot.projects[i].path),
+                    current.size, current.stamp) ||
+         !(current == stamps[i].file) || !unchanged(stamps[i].directories))) {
+      return nullptr;
+    }
+  }
+
+  byPath.clear();
+  auto solution = new Project::VSSolution(std::move(snapshot));
+  solution->name = path(slnFile).stem().string();
+  solution->path = slnFile;
+  return solution;
+}
+
+Project::ProjectIndex SolutionCache::find(Project::StringIndex projectFile,
+                                          Stamp stamp) const {
+  auto found = byPath.find(projectFile);
+  if (found == byPath.end() || !(stamps[found->second].file == stamp) ||
+      !unchanged(stamps[found->second].directories)) {
+    return Project::NoProject;
+  }
+  return found->second;
+}
+
+bool SolutionCache::unchanged(const std::vector<Directory> &directories) {
+  uint64_t stamp;
+  for (auto &directory : directories) {
+    if (!directoryStamp(StringInterner::shared().c_str(directory.path), stamp) ||
+        stamp != directory.stamp) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace Helper
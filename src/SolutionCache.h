@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Constants.h"
+#include "VSProject.h"
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Helper {
+
+// Snapshot of a parsed solution, so an unchanged one is loaded from a single
+// mapped file instead of reading the .sln and every project again. Projects
+// whose file did not change are taken from it even when others did.
+//
+// On disk, behind the magic and a version, all varints:
+//   .sln size and write time
+//   string count, then per string: length, bytes
+//   project count, then per project: name, path, id and type id as string
+//   numbers, folder flag, project file size and write time, count of the
+//   directories its globs walked, then per directory: path as string number
+//   and write time, then childs and
+//   project references as a count and project indices, then the item lists
+//   as a count and string numbers
+//   root count, then the roots
+// Strings are numbered by their place in the file and interned on load.
+struct SolutionCache {
+  explicit SolutionCache(path storage) : storage(std::move(storage)) {}
+
+  static constexpr uint32_t Magic = 0x4E4C4F53; // "SOLN"
+  static constexpr uint32_t Version = 4;
+
+  struct Stamp {
+    uint64_t size = 0;
+    uint64_t stamp = 0;
+    bool operator==(const Stamp &) const = default;
+  };
+
+  // Items expanded from globs change with the files below the project, not
+  // with the project file, so the directories walked are stamped as well.
+  struct Directory {
+    Project::StringIndex path;
+    uint64_t stamp;
+  };
+
+  struct ProjectStamp {
+    Stamp file;
+    std::vector<Directory> directories;
+  };
+
+  static bool unchanged(const std::vector<Directory> &directories);
+
+  bool load();
+  // Stamps are taken before the files are read, so a change made while
+  // parsing is picked up next time. There is one per project.
+  bool save(const Project::VSSolution &sln, Stamp slnFile,
+            const std::vector<ProjectStamp> &projectFiles);
+
+  // Hands the snapshot over if neither the solution file nor any project
+  // file changed since it was stored, otherwise returns null.
+  Project::VSSolution *solution(const string &slnFile, Stamp stamp);
+  // The stored project with this file, if neither the file nor any
+  // directory its globs walked changed.
+  Project::ProjectIndex find(Project::StringIndex projectFile,
+                             Stamp stamp) const;
+
+  path storage;
+
+  Stamp sln;
+  Project::VSSolution snapshot;
+  // One per project of the snapshot.
+  std::vector<ProjectStamp> stamps;
+  std::unordered_map<Project::StringIndex, Project::ProjectIndex> byPath;
+};
+
+} // namespace Helper
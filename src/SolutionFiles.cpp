@@ -0,0 +1,74 @@
+#include "SolutionFiles.h"
+#include "Tooling.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace Text {
+
+bool SolutionFiles::skipDirectory(const string &name) {
+  string lower = name;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return (char)std::tolower(c); });
+  return lower.ends_with("obj") || lower == "bin" || lower.starts_with(".");
+}
+
+bool SolutionFiles::isBinary(const char *data, size_t size) {
+  return std::memchr(data, 0, std::min(size, BinaryProbeSize)) != nullptr;
+}
+
+void SolutionFiles::add(const Project::VSSolution &sln,
+                        Project::ProjectIndex index) {
+  PROFILE_START;
+  if (stopped) {
+    return;
+  }
+
+  auto &project = sln.projects[index];
+  if (project.isFolder) {
+    for (auto child : sln[project.childs]) {
+      add(sln, child);
+    }
+    return;
+  }
+
+  // Old style projects list their sources, which may live outside the
+  // project directory.
+  auto directory = sln.directory(project);
+  for (auto compile : sln[project.compiles]) {
+    string name(sln.text(compile));
+    std::replace(name.begin(), name.end(), '\\', '/');
+    file((directory / name).lexically_normal());
+  }
+  walk(directory);
+}
+
+void SolutionFiles::walk(const path &directory) {
+  std::error_code ec;
+  if (!seen.insert(directory.lexically_normal().string() + "/").second) {
+    return;
+  }
+
+  for (auto &entry : directory_iterator(directory, ec)) {
+    if (stopped) {
+      return;
+    }
+
+    auto name = entry.path().filename().string();
+    if (entry.is_directory(ec)) {
+      if (!skipDirectory(name)) {
+        walk(entry.path());
+      }
+    } else if (entry.is_regular_file(ec) && !name.ends_with("proj")) {
+      file(entry.path().lexically_normal());
+    }
+  }
+}
+
+void SolutionFiles::file(const path &file) {
+  if (!stopped && seen.insert(file.string()).second && !visit(file)) {
+    stopped = true;
+  }
+}
+
+} // namespace Text
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Constants.h"
+#include "VSProject.h"
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+namespace Text {
+
+// Walks the files of a set of projects: the ones listed as compiles and
+// everything below the project directories, leaving out build output and
+// hidden directories. Every file is visited once, even when projects share
+// directories. visit returns false to stop the walk.
+struct SolutionFiles {
+  explicit SolutionFiles(std::function<bool(const path &)> visit)
+      : visit(std::move(visit)), stopped(false) {}
+
+  // Files with a zero byte in this many leading bytes count as binary.
+  static constexpr size_t BinaryProbeSize = 8000;
+
+  static bool skipDirectory(const string &name);
+  static bool isBinary(const char *data, size_t size);
+
+  void add(const Project::VSSolution &sln, Project::ProjectIndex project);
+  void walk(const path &directory);
+  void file(const path &file);
+
+  std::function<bool(const path &)> visit;
+  std::unordered_set<string> seen;
+  bool stopped;
+};
+
+} // namespace Text
@@ -0,0 +1,310 @@
+#include "SolutionSearch.h"
+#include "MappedFile.h"
+#include "SolutionFiles.h"
+#include "ThreadPool.h"
+#include "Tooling.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace Text {
+
+SolutionSearch::SolutionSearch(const Project::VSSolution *sln,
+                               std::vector<Project::ProjectIndex> projects,
+                               std::string_view pattern, bool matchCase,
+                               bool useRegex,
+                               std::shared_ptr<TrigramIndex> index)
+    : sln(sln), projects(std::move(projects)), searcher(pattern, matchCase),
+      matchCase(matchCase), useRegex(useRegex), pattern(pattern),
+      index(std::move(index)), replacing(false), cancelled(false), pending(0),
+      searched(0), found(0), skipped(0), failed(0), unrestored(0),
+      applied(false), done(false),
+      elapsed(0) {}
+
+void SolutionSearch::replaceWith(std::string_view replacement,
+                                 std::unordered_set<string> openFiles) {
+  replacing = true;
+  this->replacement = replacement;
+  this->openFiles = std::move(openFiles);
+}
+
+bool SolutionSearch::start(string &error) {
+  if (useRegex && !regex.compile(pattern, matchCase, error)) {
+    return false;
+  }
+  if (replacing &&
+      !replacer.compile(pattern, replacement, matchCase, useRegex, error)) {
+    return false;
+  }
+
+  // Regex matches all start with the prefix, which may be empty.
+  if (index && index->ready()) {
+    query = index->query(useRegex ? std::string_view(regex.prefix) : pattern);
+  }
+
+  started = std::chrono::steady_clock::now();
+  pending = 1;
+  auto self = shared_from_this();
+  Helper::ThreadPool::shared().submit([self]() {
+    self->collect();
+    self->finish();
+  });
+  return true;
+}
+
+void SolutionSearch::cancel() { cancelled = true; }
+
+void SolutionSearch::take(std::vector<FileResult> &out) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &result : results) {
+    out.push_back(std::move(result));
+  }
+  results.clear();
+}
+
+void SolutionSearch::collect() {
+  PROFILE_START;
+  SolutionFiles files([this](const path &file) { return queue(file); });
+  for (auto project : projects) {
+    files.add(*sln, project);
+  }
+}
+
+bool SolutionSearch::queue(const path &file) {
+  if (cancelled) {
+    return false;
+  }
+
+  // Temporary files of this run show up while the directories are walked.
+  if (replacing && file.extension() == ".replace~") {
+    return true;
+  }
+
+  if (replacing && openFiles.contains(file.string())) {
+    std::lock_guard<std::mutex> guard(lock);
+    results.push_back({file, file.string(), 0, {}, true});
+    return true;
+  }
+
+  if (query.filtered && !index->mayContain(query, file.string())) {
+    skipped++;
+    return true;
+  }
+
+  pending++;
+  auto self = shared_from_this();
+  Helper::ThreadPool::shared().submit([self, file]() {
+    self->search(file);
+    self->finish();
+  });
+  return true;
+}
+
+void SolutionSearch::finish() {
+  if (--pending > 0) {
+    return;
+  }
+
+  if (replacing) {
+    commit();
+  }
+  elapsed = std::chrono::steady_clock::now() - started;
+  done = true;
+}
+
+void SolutionSearch::commit() {
+  PROFILE_START;
+  if (cancelled || failed > 0) {
+    discard();
+    return;
+  }
+
+  // A hard link keeps the original without copying it, the rename then
+  // swaps the new text in without the file ever being missing.
+  std::error_code ec;
+  size_t replaced = 0;
+  for (; replaced < staged.size(); replaced++) {
+    auto &change = staged[replaced];
+    change.backup = change.file;
+    change.backup += ".backup.replace~";
+    std::filesystem::remove(change.backup, ec);
+    std::filesystem::create_hard_link(change.file, change.backup, ec);
+    if (ec) {
+      std::filesystem::copy_file(change.file, change.backup, ec);
+    }
+    if (!ec) {
+      std::filesystem::rename(change.temporary, change.file, ec);
+    }
+    if (ec) {
+      failed++;
+      break;
+    }
+  }
+
+  if (replaced < staged.size()) {
+    // The backup of the failed file is as good as the file, it still is
+    // the original.
+    for (size_t i = 0; i < replaced; i++) {
+      std::filesystem::rename(staged[i].backup, staged[i].file, ec);
+      if (ec) {
+        unrestored++;
+      }
+    }
+    std::filesystem::remove(staged[replaced].backup, ec);
+    staged.erase(staged.begin(), staged.begin() + replaced);
+    discard();
+    return;
+  }
+
+  // The index learns about the new text before anyone can search it.
+  for (auto &change : staged) {
+    std::filesystem::remove(change.backup, ec);
+    if (index) {
+      index->update(change.file, change.grams);
+    }
+  }
+  staged.clear();
+  applied = true;
+}
+
+void SolutionSearch::discard() {
+  std::error_code ec;
+  for (auto &change : staged) {
+    std::filesystem::remove(change.temporary, ec);
+  }
+  staged.clear();
+}
+
+void SolutionSearch::rewrite(const path &file) {
+  PROFILE_START;
+  string text;
+  size_t count = 0;
+  {
+    // Closed before anything is written, Windows won't replace a mapped file.
+    Helper::MappedFile mapped;
+    if (!mapped.open(file) || mapped.size == 0 ||
+        SolutionFiles::isBinary(mapped.data, mapped.size)) {
+      return;
+    }
+    count = replacer.replace(std::string_view(mapped.data, mapped.size), text);
+  }
+  searched++;
+
+  if (count == 0 || cancelled) {
+    return;
+  }
+
+  std::error_code ec;
+  auto temporary = file;
+  temporary += ".replace~";
+  std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+  stream.write(text.data(), (std::streamsize)text.size());
+  stream.close();
+  if (!stream) {
+    failed++;
+    std::filesystem::remove(temporary, ec);
+    return;
+  }
+  std::filesystem::permissions(temporary,
+                               std::filesystem::status(file, ec).permissions(),
+                               ec);
+
+  std::vector<uint32_t> grams;
+  if (index) {
+    TrigramIndex::textTrigrams(text, grams);
+  }
+
+  found += count;
+  std::lock_guard<std::mutex> guard(lock);
+  staged.push_back({file, temporary, path(), std::move(grams)});
+  results.push_back({file, file.string(), count, {}, false});
+}
+
+void SolutionSearch::search(const path &file) {
+  PROFILE_START;
+  if (cancelled) {
+    return;
+  }
+
+  if (replacing) {
+    rewrite(file);
+    return;
+  }
+
+  Helper::MappedFile mapped;
+  if (!mapped.open(file) || mapped.size == 0) {
+    return;
+  }
+
+  auto data = mapped.data;
+  auto size = mapped.size;
+  if (SolutionFiles::isBinary(data, size)) {
+    return;
+  }
+
+  std::vector<size_t> ranges;
+  if (useRegex) {
+    regex.findAll(std::string_view(data, size), ranges);
+  } else {
+    std::vector<size_t> hits;
+    searcher.findAll(data, size, hits);
+    ranges.reserve(hits.size() * 2);
+    for (auto hit : hits) {
+      ranges.push_back(hit);
+      ranges.push_back(hit + searcher.size());
+    }
+  }
+  searched++;
+
+  if (ranges.empty() || cancelled) {
+    return;
+  }
+
+  FileResult result;
+  result.file = file;
+  result.name = file.string();
+  result.count = ranges.size() / 2;
+
+  // Lines are counted as the matches go, up to the last one kept.
+  int line = 0;
+  size_t lineStart = 0;
+  size_t scanned = 0;
+  auto kept = std::min(result.count, MaxMatchesPerFile);
+  result.matches.reserve(kept);
+  for (size_t i = 0; i < kept; i++) {
+    auto offset = ranges[2 * i];
+    while (auto lineFeed = (const char *)std::memchr(data + scanned, '\n',
+                                                     offset - scanned)) {
+      line++;
+      lineStart = lineFeed - data + 1;
+      scanned = lineStart;
+    }
+    scanned = offset;
+
+    auto lineEnd = (const char *)std::memchr(data + offset, '\n', size - offset);
+    auto previewEnd = lineEnd ? (size_t)(lineEnd - data) : size;
+    auto previewStart = lineStart;
+    while (previewStart < offset && (data[previewStart] == ' ' ||
+                                     data[previewStart] == '\t')) {
+      previewStart++;
+    }
+    previewEnd = std::min(previewEnd, previewStart + MaxPreviewLength);
+    if (previewEnd > previewStart && data[previewEnd - 1] == '\r') {
+      previewEnd--;
+    }
+
+    Match match;
+    match.offset = offset;
+    match.length = ranges[2 * i + 1] - offset;
+    match.line = line;
+    match.column = (int)(offset - lineStart);
+    match.preview.assign(data + previewStart, previewEnd - previewStart);
+    result.matches.push_back(std::move(match));
+  }
+
+  found += result.count;
+  std::lock_guard<std::mutex> guard(lock);
+  results.push_back(std::move(result));
+}
+
+} // namespace Text
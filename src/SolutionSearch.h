@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Regex.h"
+#include "TextReplace.h"
+#include "TextSearch.h"
+#include "TrigramIndex.h"
+#include "VSProject.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace Text {
+
+// Searches every file of a set of projects on the shared thread pool. One
+// task walks the project directories and the files listed as compiles, each
+// file found is mapped and searched by a task of its own, unless the trigram
+// index rules it out. Results are handed over per file as they come in.
+// Tasks hold on to the search, so dropping it early only needs a cancel.
+//
+// As a replace, every file with a match is written to a temporary file next
+// to it. Once all of them are written they are renamed over the originals,
+// each of which is first linked or copied to a backup. Should a rename fail,
+// the backups are put back, so a failed or cancelled run leaves every file
+// as it was. Only a backup that cannot be put back is left on disk.
+struct SolutionSearch : std::enable_shared_from_this<SolutionSearch> {
+  // The solution has to outlive the search.
+  SolutionSearch(const Project::VSSolution *sln,
+                 std::vector<Project::ProjectIndex> projects,
+                 std::string_view pattern, bool matchCase, bool useRegex,
+                 std::shared_ptr<TrigramIndex> index);
+
+  struct Match {
+    size_t offset;
+    size_t length;
+    // Zero based, the column in bytes.
+    int line;
+    int column;
+    string preview;
+  };
+
+  struct FileResult {
+    path file;
+    // The file as the results show it, made once on the worker.
+    string name;
+    // Every match is counted, only the first MaxMatchesPerFile are kept.
+    size_t count;
+    std::vector<Match> matches;
+    // Replacing only: the file is open in an editor, which has to be patched
+    // instead, so nothing was done to it.
+    bool open = false;
+    // Shown with its matches in the results.
+    bool expanded = false;
+  };
+
+  static constexpr size_t MaxMatchesPerFile = 1000;
+  static constexpr size_t MaxPreviewLength = 200;
+
+  // Turns the run into a replace. Files in openFiles are left to the caller.
+  void replaceWith(std::string_view replacement,
+                   std::unordered_set<string> openFiles);
+  // Returns false with the reason in error if the pattern is invalid.
+  bool start(string &error);
+  void cancel();
+  // Moves the files finished since the last call out.
+  void take(std::vector<FileResult> &out);
+  bool finished() const { return done.load(); }
+  // Only meaningful once finished.
+  bool committed() const { return done.load() && applied.load(); }
+  double seconds() const { return std::chrono::duration<double>(elapsed).count(); }
+  size_t filesSearched() const { return searched.load(); }
+  size_t matchCount() const { return found.load(); }
+  size_t filesSkipped() const { return skipped.load(); }
+  size_t filesFailed() const { return failed.load(); }
+  // Files changed by a failed commit whose backup could not be put back.
+  size_t filesUnrestored() const { return unrestored.load(); }
+
+  void collect();
+  bool queue(const path &file);
+  void search(const path &file);
+  void rewrite(const path &file);
+  void finish();
+  void commit();
+  void discard();
+
+  const Project::VSSolution *sln;
+  std::vector<Project::ProjectIndex> projects;
+  Searcher searcher;
+  Regex regex;
+  bool matchCase;
+  bool useRegex;
+  string pattern;
+  std::shared_ptr<TrigramIndex> index;
+  TrigramIndex::Query query;
+
+  bool replacing;
+  Replacer replacer;
+  string replacement;
+  std::unordered_set<string> openFiles;
+  // A file, the temporary one holding its new text and the backup of the
+  // old one, along with the trigrams of the new text for the index.
+  struct Staged {
+    path file;
+    path temporary;
+    path backup;
+    std::vector<uint32_t> grams;
+  };
+  std::vector<Staged> staged;
+
+  std::mutex lock;
+  std::vector<FileResult> results;
+  std::atomic<bool> cancelled;
+  // Tasks queued or running, the collecting one included.
+  std::atomic<size_t> pending;
+  std::atomic<size_t> searched;
+  std::atomic<size_t> found;
+  std::atomic<size_t> skipped;
+  std::atomic<size_t> failed;
+  std::atomic<size_t> unrestored;
+  // Set once every staged file replaced its original.
+  std::atomic<bool> applied;
+  std::atomic<bool> done;
+  std::chrono::steady_clock::time_point started;
+  // Written before done is set.
+  std::chrono::steady_clock::duration elapsed;
+};
+
+} // namespace Text
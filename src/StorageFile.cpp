@@ -0,0 +1,75 @@
+#include "StorageFile.h"
+#include <fstream>
+
+namespace Helper {
+
+void writeVarint(string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+uint64_t VarintReader::next() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (at == end) {
+      break;
+    }
+    auto byte = *at++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  ok = false;
+  return 0;
+}
+
+bool VarintReader::bytes(size_t count, string &out) {
+  if ((size_t)(end - at) < count) {
+    ok = false;
+    return false;
+  }
+  out.assign((const char *)at, count);
+  at += count;
+  return true;
+}
+
+bool fileStamp(const path &file, uint64_t &size, uint64_t &stamp) {
+  std::error_code ec;
+  size = std::filesystem::file_size(file, ec);
+  if (ec) {
+    return false;
+  }
+  stamp = (uint64_t)std::filesystem::last_write_time(file, ec)
+              .time_since_epoch()
+              .count();
+  return !ec;
+}
+
+bool directoryStamp(const path &directory, uint64_t &stamp) {
+  std::error_code ec;
+  stamp = (uint64_t)std::filesystem::last_write_time(directory, ec)
+              .time_since_epoch()
+              .count();
+  return !ec;
+}
+
+bool replaceFile(const path &file, std::string_view contents) {
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  auto temporary = file;
+  temporary += ".tmp";
+  {
+    std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+    if (!stream.write(contents.data(), (std::streamsize)contents.size())) {
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary, file, ec);
+  return !ec;
+}
+
+} // namespace Helper
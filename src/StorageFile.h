@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Constants.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Helper {
+
+// Pieces shared by the caches kept in a solution's .vs folder. They are
+// written as varints and replaced as a whole, so a crash never leaves half
+// of one behind.
+
+void writeVarint(string &out, uint64_t value);
+
+struct VarintReader {
+  const unsigned char *at;
+  const unsigned char *end;
+  bool ok = true;
+
+  uint64_t next();
+  bool bytes(size_t count, string &out);
+};
+
+// Size and last write time, false if the file is gone.
+bool fileStamp(const path &file, uint64_t &size, uint64_t &stamp);
+// Last write time of a directory, which moves whenever an entry is added,
+// removed or renamed in it.
+bool directoryStamp(const path &directory, uint64_t &stamp);
+
+// Writes next to file first and renames over it.
+bool replaceFile(const path &file, std::string_view contents);
+
+} // namespace Helper
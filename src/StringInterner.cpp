@@ -0,0 +1,73 @@
+#include "StringInterner.h"
+#include <bit>
+#include <cstring>
+#include <functional>
+
+namespace Helper {
+
+StringInterner::~StringInterner() {
+  for (auto &segment : segments) {
+    delete[] segment.load();
+  }
+}
+
+StringInterner &StringInterner::shared() {
+  static StringInterner interner;
+  return interner;
+}
+
+StringInterner::Entry &StringInterner::slot(uint32_t id) const {
+  // Segment s starts at FirstSegment * (2^s - 1).
+  auto segment = std::bit_width(id / FirstSegment + 1) - 1;
+  auto first = FirstSegment * ((size_t(1) << segment) - 1);
+  return segments[segment].load(std::memory_order_acquire)[id - first];
+}
+
+std::string_view StringInterner::operator[](uint32_t id) const {
+  auto &entry = slot(id);
+  return std::string_view(entry.text, entry.size);
+}
+
+const char *StringInterner::store(Shard &shard, std::string_view text) {
+  auto size = text.size() + 1;
+  char *target;
+  if (size > BlockSize / 4) {
+    target = shard.blocks.emplace_back(new char[size]).get();
+  } else {
+    if (shard.used + size > BlockSize) {
+      shard.current = shard.blocks.emplace_back(new char[BlockSize]).get();
+      shard.used = 0;
+    }
+    target = shard.current + shard.used;
+    shard.used += size;
+  }
+  std::memcpy(target, text.data(), text.size());
+  target[text.size()] = '\0';
+  return target;
+}
+
+uint32_t StringInterner::intern(std::string_view text) {
+  auto &shard = shards[std::hash<std::string_view>()(text) % Shards];
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto found = shard.ids.find(text);
+  if (found != shard.ids.end()) {
+    return found->second;
+  }
+
+  auto stored = store(shard, text);
+  uint32_t id;
+  {
+    std::lock_guard<std::mutex> idGuard(idLock);
+    id = nextId++;
+    auto segment = std::bit_width(id / FirstSegment + 1) - 1;
+    if (!segments[segment].load(std::memory_order_relaxed)) {
+      segments[segment].store(new Entry[FirstSegment << segment],
+                              std::memory_order_release);
+    }
+  }
+  slot(id) = {stored, (uint32_t)text.size()};
+  shard.ids.emplace(std::string_view(stored, text.size()), id);
+  return id;
+}
+
+} // namespace Helper
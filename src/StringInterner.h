@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Helper {
+
+// Process wide set of strings. Every distinct string is copied once into
+// blocks that never move and gets the next id, so equal strings have equal
+// ids and the text of an id stays valid for the life of the process. The
+// set is split into shards with a lock each, so threads interning different
+// strings rarely wait on each other.
+struct StringInterner {
+  StringInterner() : nextId(0), segments() {}
+  ~StringInterner();
+
+  StringInterner(const StringInterner &) = delete;
+  StringInterner &operator=(const StringInterner &) = delete;
+
+  static StringInterner &shared();
+
+  uint32_t intern(std::string_view text);
+  // Only for ids handed out by intern, which may have been on another thread
+  // as long as the id was passed on from there.
+  std::string_view operator[](uint32_t id) const;
+  // Every string is followed by a zero.
+  const char *c_str(uint32_t id) const { return slot(id).text; }
+
+  static constexpr size_t Shards = 64;
+  // Strings are packed into blocks of this size, longer ones get their own.
+  static constexpr size_t BlockSize = 64 << 10;
+  // Segment s of the id table holds FirstSegment << s entries. They are
+  // allocated as needed and never move, so reads take no lock.
+  static constexpr size_t FirstSegment = 1024;
+  static constexpr size_t Segments = 22;
+
+  struct Entry {
+    const char *text;
+    uint32_t size;
+  };
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    // The block being filled.
+    char *current = nullptr;
+    size_t used = BlockSize;
+  };
+
+  Entry &slot(uint32_t id) const;
+  const char *store(Shard &shard, std::string_view text);
+
+  Shard shards[Shards];
+  std::mutex idLock;
+  uint32_t nextId;
+  std::atomic<Entry *> segments[Segments];
+};
+
+} // namespace Helper
@@ -0,0 +1,411 @@
+#include "TextBuffer.h"
+#include "LineScan.h"
+#include "Tooling.h"
+#include <algorithm>
+
+namespace Text {
+
+static inline size_t subtreeLength(const std::vector<TextBuffer::Piece> &pieces,
+                                   int node) {
+  return node < 0 ? 0 : pieces[node].subtreeLength;
+}
+
+void TextBuffer::setText(string text) {
+  auto store = std::make_shared<const string>(std::move(text));
+  load(store, store->data(), store->size());
+}
+
+void TextBuffer::setText(const char *data, size_t size) {
+  load(nullptr, data, size);
+}
+
+void TextBuffer::load(std::shared_ptr<const void> owner, const char *data,
+                      size_t size) {
+  PROFILE_START;
+  std::vector<size_t> lengths;
+  if (scanLines(data, size, lengths)) {
+    // Carriage returns are dropped, which needs a private copy.
+    auto normalized = std::make_shared<string>();
+    stripCarriageReturns(data, size, *normalized);
+    lengths.clear();
+    scanLines(normalized->data(), normalized->size(), lengths);
+
+    data = normalized->data();
+    size = normalized->size();
+    owner = std::move(normalized);
+  } else if (!owner) {
+    auto copy = std::make_shared<string>(data, size);
+    data = copy->data();
+    owner = std::move(copy);
+  }
+
+  adopt(std::move(owner), data, size);
+  lines.build(lengths);
+}
+
+void TextBuffer::rebase(std::shared_ptr<const void> owner, const char *data,
+                        size_t size) {
+  PROFILE_START;
+  // The text is unchanged, so the line index stays as it is.
+  auto keep = std::move(lines);
+  adopt(std::move(owner), data, size);
+  lines = std::move(keep);
+}
+
+void TextBuffer::adopt(std::shared_ptr<const void> owner, const char *data,
+                       size_t size) {
+  clear();
+
+  originalOwner = std::move(owner);
+  original = data;
+  originalSize = size;
+
+  if (originalSize > 0) {
+    root = newPiece(Source::Original, 0, originalSize);
+  }
+}
+
+void TextBuffer::clear() {
+  pieces.clear();
+  freeList.clear();
+  root = -1;
+  originalOwner.reset();
+  original = nullptr;
+  originalSize = 0;
+  added.clear();
+  lines.build(nullptr, 0);
+  cachedLine = -1;
+}
+
+size_t TextBuffer::size() const { return subtreeLength(pieces, root); }
+
+int TextBuffer::lineCount() const { return lines.lineCount(); }
+
+size_t TextBuffer::lineStart(int line) const { return lines.lineStart(line); }
+
+size_t TextBuffer::lineLength(int line) const {
+  auto span = lines.lineSpan(line);
+  return line + 1 < lineCount() ? span - 1 : span;
+}
+
+int TextBuffer::lineOfOffset(size_t offset) const {
+  return lines.lineOfOffset(offset);
+}
+
+std::string_view TextBuffer::line(int line) const {
+  if (line < 0 || line >= lineCount()) {
+    return {};
+  }
+
+  if (line == cachedLine) {
+    return lineScratch;
+  }
+
+  std::string_view view;
+  if (lineView(line, view)) {
+    return view;
+  }
+
+  lineScratch.clear();
+  appendText(lineStart(line), lineStart(line) + lineLength(line), lineScratch);
+  cachedLine = line;
+  return lineScratch;
+}
+
+bool TextBuffer::lineView(int line, std::string_view &view) const {
+  if (line < 0 || line >= lineCount()) {
+    view = {};
+    return true;
+  }
+
+  auto start = lineStart(line);
+  auto length = lineLength(line);
+  if (length == 0) {
+    view = {};
+    return true;
+  }
+
+  // Most lines sit inside a single piece and can be handed out directly.
+  size_t offset = start;
+  int node = root;
+  while (node >= 0) {
+    auto &piece = pieces[node];
+    auto leftLength = subtreeLength(pieces, piece.left);
+
+    if (offset < leftLength) {
+      node = piece.left;
+    } else if (offset < leftLength + piece.length) {
+      auto inPiece = offset - leftLength;
+      if (inPiece + length <= piece.length) {
+        view = std::string_view(sourceData(piece.source) + piece.start + inPiece,
+                                length);
+        return true;
+      }
+      break;
+    } else {
+      offset -= leftLength + piece.length;
+      node = piece.right;
+    }
+  }
+  return false;
+}
+
+string TextBuffer::getText(size_t from, size_t to) const {
+  PROFILE_START;
+  string result;
+  if (to > from) {
+    result.reserve(to - from);
+    appendText(from, to, result);
+  }
+  return result;
+}
+
+void TextBuffer::appendText(size_t from, size_t to, string &out) const {
+  to = std::min(to, size());
+  if (from >= to) {
+    return;
+  }
+  collect(root, 0, from, to, out);
+}
+
+void TextBuffer::collect(int node, size_t base, size_t from, size_t to,
+                         string &out) const {
+  if (node < 0) {
+    return;
+  }
+
+  auto &piece = pieces[node];
+  auto pieceStart = base + subtreeLength(pieces, piece.left);
+  auto pieceEnd = pieceStart + piece.length;
+
+  if (from < pieceStart) {
+    collect(piece.left, base, from, to, out);
+  }
+
+  if (from < pieceEnd && to > pieceStart) {
+    auto s = std::max(from, pieceStart) - pieceStart;
+    auto e = std::min(to, pieceEnd) - pieceStart;
+    out.append(sourceData(piece.source) + piece.start + s, e - s);
+  }
+
+  if (to > pieceEnd) {
+    collect(piece.right, pieceEnd, from, to, out);
+  }
+}
+
+void TextBuffer::spans(std::vector<std::string_view> &out) const {
+  collectSpans(root, added.data(), out);
+}
+
+TextBuffer::Snapshot TextBuffer::snapshot() const {
+  PROFILE_START;
+  Snapshot result;
+  result.originalOwner = originalOwner;
+  result.added = std::make_shared<const string>(added);
+  result.size = size();
+  collectSpans(root, result.added->data(), result.spans);
+  return result;
+}
+
+void TextBuffer::collectSpans(int node, const char *addedData,
+                              std::vector<std::string_view> &out) const {
+  if (node < 0) {
+    return;
+  }
+
+  auto &piece = pieces[node];
+  auto data = piece.source == Source::Original ? original : addedData;
+  collectSpans(piece.left, addedData, out);
+  out.emplace_back(data + piece.start, piece.length);
+  collectSpans(piece.right, addedData, out);
+}
+
+void TextBuffer::insert(size_t offset, const char *text, size_t length) {
+  PROFILE_START;
+  if (length == 0) {
+    return;
+  }
+
+  cachedLine = -1;
+  offset = std::min(offset, size());
+
+  auto addStart = added.size();
+  added.append(text, length);
+  lines.insert(offset, text, length);
+
+  int left, right;
+  split(root, offset, left, right);
+
+  // Typing appends to the add buffer right after the previous insertion, so
+  // the piece in front of the cursor can usually just grow.
+  if (!tryExtendLast(left, addStart, length)) {
+    left = merge(left, newPiece(Source::Added, addStart, length));
+  }
+
+  root = merge(left, right);
+}
+
+void TextBuffer::erase(size_t offset, size_t length) {
+  PROFILE_START;
+  if (length == 0 || offset >= size()) {
+    return;
+  }
+
+  cachedLine = -1;
+  length = std::min(length, size() - offset);
+  lines.erase(offset, length);
+
+  int left, middle, right;
+  split(root, offset, left, middle);
+  split(middle, length, middle, right);
+  freePieces(middle);
+  root = merge(left, right);
+}
+
+void TextBuffer::replace(const std::vector<size_t> &ranges,
+                         const std::vector<std::string_view> &replacements) {
+  PROFILE_START;
+  auto total = size();
+  for (size_t i = 0; i < replacements.size(); i++) {
+    total += replacements[i].size() - (ranges[2 * i + 1] - ranges[2 * i]);
+  }
+
+  string text;
+  text.reserve(total);
+  size_t at = 0;
+  for (size_t i = 0; i < replacements.size(); i++) {
+    appendText(at, ranges[2 * i], text);
+    text.append(replacements[i]);
+    at = ranges[2 * i + 1];
+  }
+  appendText(at, size(), text);
+
+  setText(std::move(text));
+}
+
+const char *TextBuffer::sourceData(Source source) const {
+  return source == Source::Original ? original : added.data();
+}
+
+int TextBuffer::newPiece(Source source, size_t start, size_t length) {
+  int node;
+  if (!freeList.empty()) {
+    node = freeList.back();
+    freeList.pop_back();
+  } else {
+    node = (int)pieces.size();
+    pieces.emplace_back();
+  }
+
+  // xorshift keeps priorities cheap and deterministic.
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  auto &piece = pieces[node];
+  piece.left = -1;
+  piece.right = -1;
+  piece.priority = seed;
+  piece.source = source;
+  piece.start = start;
+  piece.length = length;
+  update(node);
+  return node;
+}
+
+void TextBuffer::freePieces(int node) {
+  if (node < 0) {
+    return;
+  }
+  freePieces(pieces[node].left);
+  freePieces(pieces[node].right);
+  freeList.push_back(node);
+}
+
+void TextBuffer::update(int node) {
+  auto &piece = pieces[node];
+  piece.subtreeLength = subtreeLength(pieces, piece.left) + piece.length +
+                        subtreeLength(pieces, piece.right);
+}
+
+void TextBuffer::split(int node, size_t offset, int &left, int &right) {
+  if (node < 0) {
+    left = right = -1;
+    return;
+  }
+
+  auto leftLength = subtreeLength(pieces, pieces[node].left);
+  auto length = pieces[node].length;
+
+  if (offset <= leftLength) {
+    int l;
+    split(pieces[node].left, offset, left, l);
+    pieces[node].left = l;
+    update(node);
+    right = node;
+  } else if (offset >= leftLength + length) {
+    int r;
+    split(pieces[node].right, offset - leftLength - length, r, right);
+    pieces[node].right = r;
+    update(node);
+    left = node;
+  } else {
+    auto cut = offset - leftLength;
+    auto tail = newPiece(pieces[node].source, pieces[node].start + cut,
+                         length - cut);
+
+    auto &piece = pieces[node];
+    piece.length = cut;
+    auto nodeRight = piece.right;
+    piece.right = -1;
+    update(node);
+
+    left = node;
+    right = merge(tail, nodeRight);
+  }
+}
+
+int TextBuffer::merge(int left, int right) {
+  if (left < 0) {
+    return right;
+  }
+  if (right < 0) {
+    return left;
+  }
+
+  if (pieces[left].priority > pieces[right].priority) {
+    pieces[left].right = merge(pieces[left].right, right);
+    update(left);
+    return left;
+  }
+
+  pieces[right].left = merge(left, pieces[right].left);
+  update(right);
+  return right;
+}
+
+bool TextBuffer::tryExtendLast(int node, size_t addStart, size_t length) {
+  if (node < 0) {
+    return false;
+  }
+
+  int last = node;
+  while (pieces[last].right >= 0) {
+    last = pieces[last].right;
+  }
+
+  auto &piece = pieces[last];
+  if (piece.source != Source::Added ||
+      piece.start + piece.length != addStart) {
+    return false;
+  }
+
+  piece.length += length;
+
+  for (int n = node; n >= 0; n = pieces[n].right) {
+    pieces[n].subtreeLength += length;
+  }
+  return true;
+}
+
+} // namespace Text
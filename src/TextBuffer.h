@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Constants.h"
+#include "LineIndex.h"
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace Text {
+
+// Piece table over a read-only original span and an append-only add buffer.
+// Pieces live in an implicit treap ordered by text position, every node keeps
+// the byte total of its subtree so edits are O(log n). Line lookups go
+// through a separate LineIndex that is updated alongside every edit.
+struct TextBuffer {
+  TextBuffer()
+      : root(-1), original(nullptr), originalSize(0), cachedLine(-1) {}
+
+  enum class Source : uint8_t { Original, Added };
+
+  // Read-only copy of the text that can outlive later edits and be read from
+  // another thread. The original is shared, only the add buffer is copied.
+  struct Snapshot {
+    std::shared_ptr<const void> originalOwner;
+    std::shared_ptr<const string> added;
+    std::vector<std::string_view> spans;
+    size_t size = 0;
+  };
+
+  struct Piece {
+    int left;
+    int right;
+    uint32_t priority;
+    Source source;
+    size_t start;
+    size_t length;
+    size_t subtreeLength;
+  };
+
+  void setText(string text);
+  // Line breaks and carriage returns are found in a single scan. The text is
+  // copied, normalized if it contains carriage returns, so a mapped file can
+  // be closed right after and never changes or faults under the buffer.
+  void setText(const char *data, size_t size);
+  // Moves the buffer onto new storage holding exactly the current text.
+  void rebase(std::shared_ptr<const void> owner, const char *data,
+              size_t size);
+  // Text with an owner is the buffer's alone and never copied.
+  void load(std::shared_ptr<const void> owner, const char *data, size_t size);
+  void adopt(std::shared_ptr<const void> owner, const char *data, size_t size);
+  void clear();
+
+  size_t size() const;
+  int lineCount() const;
+  size_t lineStart(int line) const;
+  size_t lineLength(int line) const;
+  int lineOfOffset(size_t offset) const;
+
+  // The returned view stays valid until the next call with a different line
+  // or the next edit.
+  std::string_view line(int line) const;
+  // Only succeeds when the line is stored contiguously. The view stays valid
+  // until the next edit.
+  bool lineView(int line, std::string_view &view) const;
+  string getText(size_t from, size_t to) const;
+  void appendText(size_t from, size_t to, string &out) const;
+  // Appends the pieces in text order, the views stay valid until the next
+  // edit.
+  void spans(std::vector<std::string_view> &out) const;
+  Snapshot snapshot() const;
+
+  void insert(size_t offset, const char *text, size_t length);
+  void erase(size_t offset, size_t length);
+  // Replaces the sorted, non-overlapping ranges, given as start and end
+  // pairs, with the matching replacements. The new text is built in one pass
+  // into a single allocation and becomes the original, so the pieces and the
+  // line index start over instead of taking one edit per range.
+  void replace(const std::vector<size_t> &ranges,
+               const std::vector<std::string_view> &replacements);
+
+  const char *sourceData(Source source) const;
+  int newPiece(Source source, size_t start, size_t length);
+  void freePieces(int node);
+  void update(int node);
+  void split(int node, size_t offset, int &left, int &right);
+  int merge(int left, int right);
+  bool tryExtendLast(int node, size_t addStart, size_t length);
+  void collect(int node, size_t base, size_t from, size_t to, string &out) const;
+  void collectSpans(int node, const char *addedData,
+                    std::vector<std::string_view> &out) const;
+
+  std::vector<Piece> pieces;
+  std::vector<int> freeList;
+  int root;
+  uint32_t seed = 0x9E3779B9u;
+
+  std::shared_ptr<const void> originalOwner;
+  const char *original;
+  size_t originalSize;
+  string added;
+  LineIndex lines;
+
+  mutable int cachedLine;
+  mutable string lineScratch;
+};
+
+} // namespace Text
@@ -0,0 +1,87 @@
+#include "TextReplace.h"
+#include "Tooling.h"
+
+namespace Text {
+
+bool Replacer::compile(std::string_view pattern, std::string_view replacement,
+                       bool matchCase, bool useRegex, string &error) {
+  this->replacement = replacement;
+  this->useRegex = useRegex;
+  if (pattern.empty()) {
+    error = "Nothing to search for";
+    return false;
+  }
+
+  if (useRegex) {
+    return regex.compile(pattern, matchCase, error);
+  }
+  searcher = std::make_unique<Searcher>(pattern, matchCase);
+  return true;
+}
+
+size_t Replacer::collect(std::string_view text, std::vector<size_t> &ranges,
+                         std::vector<std::string_view> &replacements,
+                         string &expanded) const {
+  PROFILE_START;
+  auto first = replacements.size();
+  if (!useRegex) {
+    std::vector<size_t> hits;
+    searcher->findAll(text.data(), text.size(), hits);
+    for (auto hit : hits) {
+      ranges.push_back(hit);
+      ranges.push_back(hit + searcher->size());
+      replacements.push_back(replacement);
+    }
+    return hits.size();
+  }
+
+  // $1 and friends need the groups of every match, so the replacements are
+  // expanded up front against the unchanged text.
+  std::vector<size_t> matches, groups, replacementEnds;
+  regex.findAllGroups(text, matches);
+  auto stride = (size_t)regex.groupCount * 2;
+  auto expandedStart = expanded.size();
+  for (size_t at = 0; at < matches.size(); at += stride) {
+    groups.assign(matches.begin() + at, matches.begin() + at + stride);
+    ranges.push_back(groups[0]);
+    ranges.push_back(groups[1]);
+    regex.expand(replacement, text, groups, expanded);
+    replacementEnds.push_back(expanded.size());
+  }
+
+  // Views are taken once expanded is done growing.
+  for (size_t i = 0; i < replacementEnds.size(); i++) {
+    auto start = i > 0 ? replacementEnds[i - 1] : expandedStart;
+    replacements.emplace_back(expanded.data() + start,
+                              replacementEnds[i] - start);
+  }
+  return replacements.size() - first;
+}
+
+size_t Replacer::replace(std::string_view text, string &out) const {
+  std::vector<size_t> ranges;
+  std::vector<std::string_view> replacements;
+  string expanded;
+  auto count = collect(text, ranges, replacements, expanded);
+  if (count == 0) {
+    return 0;
+  }
+
+  auto total = text.size();
+  for (size_t i = 0; i < count; i++) {
+    total += replacements[i].size() - (ranges[2 * i + 1] - ranges[2 * i]);
+  }
+
+  out.clear();
+  out.reserve(total);
+  size_t at = 0;
+  for (size_t i = 0; i < count; i++) {
+    out.append(text.substr(at, ranges[2 * i] - at));
+    out.append(replacements[i]);
+    at = ranges[2 * i + 1];
+  }
+  out.append(text.substr(at));
+  return count;
+}
+
+} // namespace Text
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Constants.h"
+#include "Regex.h"
+#include "TextSearch.h"
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace Text {
+
+// Replace All over a flat text, either for a literal or for a regex whose
+// replacement may refer to groups as $1. Matches don't overlap. Empty regex
+// matches, such as the ones of ^ or \b, get the replacement inserted.
+struct Replacer {
+  Replacer() : useRegex(false) {}
+
+  // Returns false with the reason in error if the pattern is invalid.
+  bool compile(std::string_view pattern, std::string_view replacement,
+               bool matchCase, bool useRegex, string &error);
+
+  // Appends start and end of every match to ranges and what replaces it to
+  // replacements. The views point into expanded or into the replacement, so
+  // they live as long as both of those.
+  size_t collect(std::string_view text, std::vector<size_t> &ranges,
+                 std::vector<std::string_view> &replacements,
+                 string &expanded) const;
+  // Writes the text with every match replaced to out in a single
+  // allocation. Returns the number of replacements, out is left alone when
+  // there are none.
+  size_t replace(std::string_view text, string &out) const;
+
+  string replacement;
+  bool useRegex;
+  std::unique_ptr<Searcher> searcher;
+  Regex regex;
+};
+
+} // namespace Text
@@ -0,0 +1,294 @@
+#include "TextSearch.h"
+#include "LineScan.h"
+#include "Tooling.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) ||            \
+    defined(__i386__)
+#define TEXT_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Text {
+
+static inline uint8_t foldCase(uint8_t c) {
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+#if TEXT_SEARCH_X86
+
+// Bytes are signed here, so anything above 0x7F never lands in the range.
+static inline __m128i foldCase(__m128i chunk) {
+  auto upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('A' - 1)),
+                             _mm_cmplt_epi8(chunk, _mm_set1_epi8('Z' + 1)));
+  return _mm_or_si128(chunk, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+#endif
+
+Searcher::Searcher(std::string_view text, bool matchCase)
+    : pattern(text), matchCase(matchCase) {
+  if (!matchCase) {
+    for (auto &c : pattern) {
+      c = (char)foldCase((uint8_t)c);
+    }
+  }
+
+  auto m = pattern.size();
+  std::fill(std::begin(shift), std::end(shift), m);
+  for (size_t i = 0; i + 1 < m; i++) {
+    auto c = (uint8_t)pattern[i];
+    shift[c] = m - 1 - i;
+    // Text bytes are looked up unfolded, so upper case letters need the
+    // same distance as their lower case twins.
+    if (!matchCase && c >= 'a' && c <= 'z') {
+      shift[c & ~0x20] = m - 1 - i;
+    }
+  }
+}
+
+bool Searcher::equals(const char *text) const {
+  if (matchCase) {
+    return memcmp(text, pattern.data(), pattern.size()) == 0;
+  }
+
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if (foldCase((uint8_t)text[i]) != (uint8_t)pattern[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Searcher::find(const char *data, size_t size, size_t from) const {
+  auto m = pattern.size();
+  if (m == 0 || from > size || size - from < m) {
+    return npos;
+  }
+
+  if (m == 1 && matchCase) {
+    auto hit = (const char *)memchr(data + from, pattern[0], size - from);
+    return hit ? (size_t)(hit - data) : npos;
+  }
+
+  return m >= LongPattern ? findHorspool(data, size, from)
+                          : findFiltered(data, size, from);
+}
+
+size_t Searcher::findFiltered(const char *data, size_t size,
+                              size_t from) const {
+  auto m = pattern.size();
+  auto first = (uint8_t)pattern[0];
+  auto last = (uint8_t)pattern[m - 1];
+  auto i = from;
+
+#if TEXT_SEARCH_X86
+  auto firstBytes = _mm_set1_epi8((char)first);
+  auto lastBytes = _mm_set1_epi8((char)last);
+
+  // Candidates need both the first and the last byte in place, which throws
+  // away nearly every position before anything is compared in full.
+  for (; i + m - 1 + 16 <= size; i += 16) {
+    auto head = _mm_loadu_si128((const __m128i *)(data + i));
+    auto tail = _mm_loadu_si128((const __m128i *)(data + i + m - 1));
+    if (!matchCase) {
+      head = foldCase(head);
+      tail = foldCase(tail);
+    }
+
+    auto mask = (uint32_t)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(head, firstBytes),
+                      _mm_cmpeq_epi8(tail, lastBytes)));
+    while (mask) {
+      auto candidate = i + countTrailingZeros(mask);
+      if (equals(data + candidate)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; i + m <= size; i++) {
+    auto c = (uint8_t)data[i];
+    if ((matchCase ? c : foldCase(c)) == first && equals(data + i)) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+size_t Searcher::findHorspool(const char *data, size_t size,
+                              size_t from) const {
+  auto m = pattern.size();
+  auto last = (uint8_t)pattern[m - 1];
+
+  for (auto i = from; i + m <= size;) {
+    auto c = (uint8_t)data[i + m - 1];
+    if ((matchCase ? c : foldCase(c)) == last && equals(data + i)) {
+      return i;
+    }
+    i += shift[c];
+  }
+  return npos;
+}
+
+void Searcher::findAll(const char *data, size_t size,
+                       std::vector<size_t> &hits) const {
+  PROFILE_START;
+  if (pattern.empty()) {
+    return;
+  }
+
+  for (auto pos = find(data, size, 0); pos != npos;
+       pos = find(data, size, pos + pattern.size())) {
+    hits.push_back(pos);
+  }
+}
+
+void Searcher::findAll(const std::vector<std::string_view> &spans,
+                       std::vector<size_t> &hits) const {
+  PROFILE_START;
+  auto m = pattern.size();
+  if (m == 0) {
+    return;
+  }
+
+  std::vector<size_t> starts;
+  starts.reserve(spans.size() + 1);
+  size_t total = 0;
+  for (auto &span : spans) {
+    starts.push_back(total);
+    total += span.size();
+  }
+  starts.push_back(total);
+
+  // Earliest offset a match may start at without overlapping the last one.
+  size_t next = 0;
+  string window;
+
+  for (size_t s = 0; s < spans.size(); s++) {
+    auto base = starts[s];
+
+    // Matches crossing into this span start within m - 1 bytes before it.
+    // Those bytes and as many after it are copied out and searched on their
+    // own, which keeps the spans themselves untouched.
+    if (s > 0 && m > 1) {
+      auto from = std::max(base - std::min(base, m - 1), next);
+      auto to = std::min(base + m - 1, total);
+
+      window.clear();
+      auto w = (size_t)(std::upper_bound(starts.begin(), starts.end(), from) -
+                        starts.begin()) - 1;
+      for (; w < spans.size() && starts[w] < to; w++) {
+        auto b = std::max(from, starts[w]) - starts[w];
+        auto e = std::min(to, starts[w + 1]) - starts[w];
+        window.append(spans[w].data() + b, e - b);
+      }
+
+      for (auto pos = find(window.data(), window.size(), 0);
+           pos != npos && from + pos < base;
+           pos = find(window.data(), window.size(), pos + m)) {
+        hits.push_back(from + pos);
+        next = from + pos + m;
+      }
+    }
+
+    auto &span = spans[s];
+    for (auto pos = find(span.data(), span.size(), std::max(next, base) - base);
+         pos != npos; pos = find(span.data(), span.size(), pos + m)) {
+      hits.push_back(base + pos);
+      next = base + pos + m;
+    }
+  }
+}
+
+void Searcher::findAll(const std::vector<std::string_view> &spans, size_t from,
+                       size_t to, std::vector<size_t> &hits) const {
+  std::vector<std::string_view> clipped;
+  size_t start = 0;
+  for (auto &span : spans) {
+    auto end = start + span.size();
+    if (end > from && start < to) {
+      auto b = std::max(from, start) - start;
+      auto e = std::min(to, end) - start;
+      clipped.push_back(span.substr(b, e - b));
+    }
+    start = end;
+  }
+
+  auto first = hits.size();
+  findAll(clipped, hits);
+  for (auto i = first; i < hits.size(); i++) {
+    hits[i] += from;
+  }
+}
+
+void Searcher::refine(const std::vector<std::string_view> &spans,
+                      const std::vector<size_t> &candidates,
+                      std::vector<size_t> &hits) const {
+  PROFILE_START;
+  auto m = pattern.size();
+  if (m == 0) {
+    return;
+  }
+
+  size_t span = 0;
+  size_t spanStart = 0;
+  size_t next = 0;
+  string window;
+
+  for (auto candidate : candidates) {
+    if (candidate < next) {
+      continue;
+    }
+
+    while (span < spans.size() &&
+           spanStart + spans[span].size() <= candidate) {
+      spanStart += spans[span].size();
+      span++;
+    }
+    if (span == spans.size()) {
+      break;
+    }
+
+    // Candidates running into the next span are copied out first.
+    auto inSpan = candidate - spanStart;
+    const char *text = spans[span].data() + inSpan;
+    if (inSpan + m > spans[span].size()) {
+      window.assign(text, spans[span].size() - inSpan);
+      for (auto s = span + 1; s < spans.size() && window.size() < m; s++) {
+        window.append(spans[s].substr(0, m - window.size()));
+      }
+      if (window.size() < m) {
+        break;
+      }
+      text = window.data();
+    }
+
+    if (equals(text)) {
+      hits.push_back(candidate);
+      next = candidate + m;
+    }
+  }
+}
+
+bool Searcher::selfOverlaps() const {
+  // Longest proper prefix that is also a suffix, as in Knuth-Morris-Pratt.
+  auto m = pattern.size();
+  std::vector<size_t> border(m, 0);
+  for (size_t i = 1; i < m; i++) {
+    auto k = border[i - 1];
+    while (k > 0 && pattern[i] != pattern[k]) {
+      k = border[k - 1];
+    }
+    if (pattern[i] == pattern[k]) {
+      k++;
+    }
+    border[i] = k;
+  }
+  return m > 0 && border[m - 1] > 0;
+}
+
+} // namespace Text
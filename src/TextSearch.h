@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Constants.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Text {
+
+// Literal substring search over raw UTF-8 bytes. Short patterns are found by
+// comparing their first and last byte against 16 bytes at a time and only
+// verifying candidates, long ones use Boyer-Moore-Horspool. Without
+// matchCase both sides are compared with ASCII letters folded to lower case.
+struct Searcher {
+  Searcher(std::string_view pattern, bool matchCase);
+
+  static constexpr size_t npos = (size_t)-1;
+  // Patterns at least this long skip ahead with Horspool instead.
+  static constexpr size_t LongPattern = 32;
+
+  size_t size() const { return pattern.size(); }
+  bool empty() const { return pattern.empty(); }
+
+  // Offset of the first match starting at or after from, or npos.
+  size_t find(const char *data, size_t size, size_t from) const;
+  // Appends the offset of every non-overlapping match in data.
+  void findAll(const char *data, size_t size, std::vector<size_t> &hits) const;
+  // Same for text split over several spans, matches may cross from one span
+  // into the next. Offsets count from the start of the first span.
+  void findAll(const std::vector<std::string_view> &spans,
+               std::vector<size_t> &hits) const;
+  // Only matches lying entirely within [from, to) of the spans.
+  void findAll(const std::vector<std::string_view> &spans, size_t from,
+               size_t to, std::vector<size_t> &hits) const;
+
+  // Keeps the candidates the pattern matches at, skipping any that overlap
+  // the previous hit. Candidates have to be ascending.
+  void refine(const std::vector<std::string_view> &spans,
+              const std::vector<size_t> &candidates,
+              std::vector<size_t> &hits) const;
+  // Whether a match can overlap the next one ("aa" in "aaa"). If not, the
+  // non-overlapping hits are every occurrence, which refine relies on.
+  bool selfOverlaps() const;
+
+  bool equals(const char *text) const;
+  size_t findFiltered(const char *data, size_t size, size_t from) const;
+  size_t findHorspool(const char *data, size_t size, size_t from) const;
+
+  string pattern;
+  bool matchCase;
+  size_t shift[256];
+};
+
+} // namespace Text
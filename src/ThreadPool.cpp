@@ -0,0 +1,100 @@
+#include "ThreadPool.h"
+#include "Tooling.h"
+#include <algorithm>
+
+namespace Helper {
+
+// Queue index of the worker running on this thread, -1 elsewhere.
+static thread_local int t_workerIndex = -1;
+
+ThreadPool::ThreadPool(unsigned threads)
+    : nextQueue(0), queued(0), stopping(false) {
+  threads = std::max(1u, threads);
+  for (unsigned i = 0; i < threads; i++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    workers.emplace_back([this, i]() { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool(std::thread::hardware_concurrency());
+  return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  auto index = t_workerIndex >= 0 ? (unsigned)t_workerIndex
+                                  : nextQueue++ % (unsigned)queues.size();
+  {
+    std::lock_guard<std::mutex> guard(queues[index]->lock);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    queued++;
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::pop(unsigned index, std::function<void()> &task) {
+  {
+    auto &own = *queues[index];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues.size(); i++) {
+    auto &other = *queues[(index + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(other.lock);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(unsigned index) {
+  t_workerIndex = (int)index;
+  std::function<void()> task;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(sleepLock);
+      wake.wait(guard, [this]() { return stopping || queued > 0; });
+      if (queued == 0) {
+        return;
+      }
+      // Claimed before popping, so a task is never looked for twice.
+      queued--;
+    }
+
+    // The claimed task is in some queue, though another worker may take it
+    // first and leave this one to find the next.
+    while (!pop(index, task)) {
+      std::this_thread::yield();
+    }
+
+    PROFILE_START_NAMED("ThreadPool task");
+    task();
+    task = nullptr;
+  }
+}
+
+} // namespace Helper
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Helper {
+
+// Fixed set of workers, each with its own task queue. A worker runs its own
+// queue newest first and steals the oldest tasks of the others once it runs
+// dry, so one long task never holds up the ones queued behind it. Tasks
+// submitted from inside a task stay on the submitting worker's queue.
+struct ThreadPool {
+  explicit ThreadPool(unsigned threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // One worker per hardware thread, created on first use.
+  static ThreadPool &shared();
+
+  void submit(std::function<void()> task);
+  unsigned size() const { return (unsigned)workers.size(); }
+
+  struct Queue {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(unsigned index);
+  bool pop(unsigned index, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<unsigned> nextQueue;
+
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  size_t queued;
+  bool stopping;
+};
+
+} // namespace Helper
@@ -0,0 +1,392 @@
+#include "TrigramIndex.h"
+#include "MappedFile.h"
+#include "SolutionFiles.h"
+#include "StorageFile.h"
+#include "ThreadPool.h"
+#include "Tooling.h"
+#include <algorithm>
+#include <iterator>
+
+namespace Text {
+
+using Helper::fileStamp;
+using Helper::VarintReader;
+using Helper::writeVarint;
+
+void TrigramIndex::trigrams(const char *data, size_t size,
+                            std::vector<uint32_t> &out) {
+  out.clear();
+  if (size < 3) {
+    return;
+  }
+
+  auto fold = [](unsigned char c) -> uint32_t {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+  };
+
+  out.reserve(size - 2);
+  uint32_t gram = fold(data[0]) << 8 | fold(data[1]);
+  for (size_t i = 2; i < size; i++) {
+    gram = (gram << 8 | fold(data[i])) & 0xFFFFFF;
+    out.push_back(gram);
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+bool TrigramIndex::load() {
+  PROFILE_START;
+  Helper::MappedFile file;
+  if (!file.open(storage) || file.size == 0) {
+    return false;
+  }
+
+  VarintReader reader{(const unsigned char *)file.data,
+                      (const unsigned char *)file.data + file.size};
+  if (reader.next() != Magic || reader.next() != Version) {
+    return false;
+  }
+
+  std::vector<Entry> loadedEntries;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> loadedPostings;
+
+  auto fileCount = reader.next();
+  for (uint64_t i = 0; i < fileCount && reader.ok; i++) {
+    Entry entry;
+    entry.live = true;
+    reader.bytes(reader.next(), entry.file);
+    entry.size = reader.next();
+    entry.stamp = reader.next();
+    loadedEntries.push_back(std::move(entry));
+  }
+
+  uint32_t gram = 0;
+  auto gramCount = reader.next();
+  for (uint64_t i = 0; i < gramCount && reader.ok; i++) {
+    gram += (uint32_t)reader.next();
+    auto &posting = loadedPostings[gram];
+    uint32_t id = 0;
+    auto count = reader.next();
+    for (uint64_t j = 0; j < count && reader.ok; j++) {
+      id += (uint32_t)reader.next();
+      if (id >= loadedEntries.size()) {
+        reader.ok = false;
+      }
+      posting.push_back(id);
+    }
+  }
+
+  if (!reader.ok) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  entries = std::move(loadedEntries);
+  postings = std::move(loadedPostings);
+  ids.clear();
+  for (uint32_t id = 0; id < entries.size(); id++) {
+    ids[entries[id].file] = id;
+  }
+  return true;
+}
+
+bool TrigramIndex::save() {
+  PROFILE_START;
+  string out;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Dropped entries are left out and the rest numbered without gaps, in
+    // the file as well as in memory.
+    std::vector<uint32_t> remap(entries.size(), UINT32_MAX);
+    std::vector<Entry> liveEntries;
+    uint32_t live = 0;
+    for (uint32_t id = 0; id < entries.size(); id++) {
+      if (entries[id].live) {
+        remap[id] = live++;
+        liveEntries.push_back(std::move(entries[id]));
+      }
+    }
+
+    writeVarint(out, Magic);
+    writeVarint(out, Version);
+    writeVarint(out, live);
+    for (auto &entry : liveEntries) {
+      writeVarint(out, entry.file.size());
+      out.append(entry.file);
+      writeVarint(out, entry.size);
+      writeVarint(out, entry.stamp);
+    }
+
+    std::vector<uint32_t> grams;
+    grams.reserve(postings.size());
+    for (auto &posting : postings) {
+      grams.push_back(posting.first);
+    }
+    std::sort(grams.begin(), grams.end());
+
+    string body;
+    uint32_t count = 0;
+    uint32_t previousGram = 0;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> livePostings;
+    for (auto gram : grams) {
+      std::vector<uint32_t> fileIds;
+      for (auto id : postings[gram]) {
+        if (remap[id] != UINT32_MAX) {
+          fileIds.push_back(remap[id]);
+        }
+      }
+      if (fileIds.empty()) {
+        continue;
+      }
+
+      writeVarint(body, gram - previousGram);
+      writeVarint(body, fileIds.size());
+      uint32_t previousId = 0;
+      for (auto id : fileIds) {
+        writeVarint(body, id - previousId);
+        previousId = id;
+      }
+      previousGram = gram;
+      count++;
+      livePostings.emplace(gram, std::move(fileIds));
+    }
+
+    writeVarint(out, count);
+    out.append(body);
+
+    // Queries made before hold the old ids.
+    if (live != entries.size()) {
+      epoch++;
+    }
+    entries = std::move(liveEntries);
+    postings = std::move(livePostings);
+    for (auto &id : ids) {
+      id.second = remap[id.second];
+    }
+  }
+
+  return Helper::replaceFile(storage, out);
+}
+
+void TrigramIndex::build(const Project::VSSolution *sln) {
+  if (building.exchange(true)) {
+    return;
+  }
+
+  pending = 1;
+  auto self = shared_from_this();
+  Helper::ThreadPool::shared().submit([self, sln]() {
+    self->load();
+    self->refresh(*sln);
+    self->finish();
+  });
+}
+
+void TrigramIndex::refresh(const Project::VSSolution &sln) {
+  PROFILE_START;
+  auto self = shared_from_this();
+  SolutionFiles files([&](const path &file) {
+    uint64_t size, stamp;
+    if (!fileStamp(file, size, stamp)) {
+      return true;
+    }
+
+    auto name = file.string();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      visited.insert(name);
+      auto found = ids.find(name);
+      if (found != ids.end() && entries[found->second].size == size &&
+          entries[found->second].stamp == stamp) {
+        return true;
+      }
+    }
+
+    pending++;
+    Helper::ThreadPool::shared().submit([self, file, size, stamp]() {
+      self->index(file, size, stamp);
+      self->finish();
+    });
+    return true;
+  });
+
+  for (auto project : sln.roots) {
+    files.add(sln, project);
+  }
+}
+
+void TrigramIndex::index(const path &file, uint64_t size, uint64_t stamp) {
+  PROFILE_START;
+  if (size > MaxIndexedSize) {
+    std::lock_guard<std::mutex> guard(lock);
+    remove(file.string());
+    return;
+  }
+
+  Helper::MappedFile mapped;
+  if (!mapped.open(file)) {
+    return;
+  }
+
+  // Binary files stay in without trigrams, searches skip them anyway.
+  std::vector<uint32_t> grams;
+  if (!SolutionFiles::isBinary(mapped.data, mapped.size)) {
+    trigrams(mapped.data, mapped.size, grams);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  add(file.string(), size, stamp, grams);
+}
+
+void TrigramIndex::finish() {
+  if (--pending > 0) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &entry : entries) {
+      if (entry.live && !visited.contains(entry.file)) {
+        remove(entry.file);
+      }
+    }
+    visited.clear();
+  }
+
+  save();
+  built = true;
+}
+
+void TrigramIndex::textTrigrams(std::string_view text,
+                                std::vector<uint32_t> &out) {
+  out.clear();
+  if (text.size() <= MaxIndexedSize &&
+      !SolutionFiles::isBinary(text.data(), text.size())) {
+    trigrams(text.data(), text.size(), out);
+  }
+}
+
+void TrigramIndex::update(const path &file, std::string_view text,
+                          uint64_t size, uint64_t stamp) {
+  PROFILE_START;
+  std::vector<uint32_t> grams;
+  textTrigrams(text, grams);
+
+  // Checked under the lock, a later write is then indexed after this one.
+  auto name = file.lexically_normal().string();
+  std::lock_guard<std::mutex> guard(lock);
+  uint64_t currentSize, currentStamp;
+  if (!fileStamp(file, currentSize, currentStamp) || currentSize != size ||
+      currentStamp != stamp) {
+    return;
+  }
+  if (size > MaxIndexedSize) {
+    remove(name);
+  } else {
+    add(name, size, stamp, grams);
+  }
+}
+
+void TrigramIndex::update(const path &file,
+                          const std::vector<uint32_t> &grams) {
+  uint64_t size, stamp;
+  if (!fileStamp(file, size, stamp)) {
+    return;
+  }
+
+  auto name = file.lexically_normal().string();
+  std::lock_guard<std::mutex> guard(lock);
+  if (size > MaxIndexedSize) {
+    remove(name);
+  } else {
+    add(name, size, stamp, grams);
+  }
+}
+
+void TrigramIndex::add(const string &file, uint64_t size, uint64_t stamp,
+                       const std::vector<uint32_t> &grams) {
+  remove(file);
+
+  // Ids only grow, which keeps every posting list sorted.
+  auto id = (uint32_t)entries.size();
+  entries.push_back({file, size, stamp, true});
+  ids[file] = id;
+  for (auto gram : grams) {
+    postings[gram].push_back(id);
+  }
+}
+
+void TrigramIndex::remove(const string &file) {
+  auto found = ids.find(file);
+  if (found != ids.end()) {
+    entries[found->second].live = false;
+    ids.erase(found);
+  }
+}
+
+TrigramIndex::Query TrigramIndex::query(std::string_view literal) const {
+  PROFILE_START;
+  Query result;
+  std::lock_guard<std::mutex> guard(lock);
+  result.generation = (uint32_t)entries.size();
+  result.epoch = epoch;
+  if (literal.size() < 3) {
+    return result;
+  }
+
+  std::vector<uint32_t> grams;
+  trigrams(literal.data(), literal.size(), grams);
+  result.filtered = true;
+
+  std::vector<const std::vector<uint32_t> *> lists;
+  for (auto gram : grams) {
+    auto found = postings.find(gram);
+    if (found == postings.end()) {
+      return result;
+    }
+    lists.push_back(&found->second);
+  }
+
+  // Shortest lists first, so the candidates shrink as early as possible.
+  std::sort(lists.begin(), lists.end(),
+            [](auto a, auto b) { return a->size() < b->size(); });
+  result.candidates = *lists[0];
+  std::vector<uint32_t> remaining;
+  for (size_t i = 1; i < lists.size() && !result.candidates.empty(); i++) {
+    remaining.clear();
+    std::set_intersection(result.candidates.begin(), result.candidates.end(),
+                          lists[i]->begin(), lists[i]->end(),
+                          std::back_inserter(remaining));
+    result.candidates.swap(remaining);
+  }
+  return result;
+}
+
+bool TrigramIndex::mayContain(const Query &query, const string &file) const {
+  if (!query.filtered) {
+    return true;
+  }
+
+  uint64_t size, stamp;
+  if (!fileStamp(file, size, stamp)) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (query.epoch != epoch) {
+    return true;
+  }
+  auto found = ids.find(file);
+  if (found == ids.end() || found->second >= query.generation) {
+    return true;
+  }
+  auto &entry = entries[found->second];
+  if (entry.size != size || entry.stamp != stamp) {
+    return true;
+  }
+  return std::binary_search(query.candidates.begin(), query.candidates.end(),
+                            found->second);
+}
+
+} // namespace Text
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Constants.h"
+#include "VSProject.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Text {
+
+// Maps every three byte sequence, ASCII letters folded to lower case, to the
+// sorted ids of the files containing it. A literal can then only occur in
+// files listed under all of its trigrams, every other file is skipped
+// without being read. Changed files get a new id, their old one stays until
+// the index is written and the ids are renumbered.
+//
+// On disk, behind the magic and a version, all varints:
+//   file count, then per file: path length, path bytes, size, write time
+//   trigram count, then per trigram: delta to the previous trigram,
+//   posting count, deltas between consecutive file ids
+struct TrigramIndex : std::enable_shared_from_this<TrigramIndex> {
+  explicit TrigramIndex(path storage)
+      : storage(std::move(storage)), epoch(0), pending(0), building(false),
+        built(false) {}
+
+  struct Entry {
+    string file;
+    uint64_t size;
+    uint64_t stamp;
+    bool live;
+  };
+
+  // Candidates of one literal. Files that got an id after the query was made
+  // are not covered by it, nor is anything once the ids were renumbered.
+  struct Query {
+    bool filtered = false;
+    uint32_t generation = 0;
+    uint32_t epoch = 0;
+    std::vector<uint32_t> candidates;
+  };
+
+  static constexpr uint32_t Magic = 0x4D475254; // "TRGM"
+  static constexpr uint32_t Version = 1;
+  // Larger files are left out and always searched.
+  static constexpr size_t MaxIndexedSize = 16 << 20;
+
+  static void trigrams(const char *data, size_t size,
+                       std::vector<uint32_t> &out);
+  // Trigrams of a file's text, none for text the index leaves out.
+  static void textTrigrams(std::string_view text, std::vector<uint32_t> &out);
+
+  bool load();
+  bool save();
+  // Reads the stored index, then brings it up to date with the files of the
+  // solution on the shared thread pool and writes it back. The solution has
+  // to outlive the build.
+  void build(const Project::VSSolution *sln);
+  // Indexes a file written with the given text, which left it at the given
+  // size and stamp. Runs on any thread; if the file was written again since,
+  // the update is stale and skipped.
+  void update(const path &file, std::string_view text, uint64_t size,
+              uint64_t stamp);
+  // Same with the trigrams of the text already at hand.
+  void update(const path &file, const std::vector<uint32_t> &grams);
+  bool ready() const { return built.load(); }
+
+  Query query(std::string_view literal) const;
+  // Files changed on disk since they were indexed, for instance by a
+  // checkout, always may.
+  bool mayContain(const Query &query, const string &file) const;
+
+  void refresh(const Project::VSSolution &sln);
+  void index(const path &file, uint64_t size, uint64_t stamp);
+  void finish();
+  // Callers hold lock.
+  void add(const string &file, uint64_t size, uint64_t stamp,
+           const std::vector<uint32_t> &grams);
+  void remove(const string &file);
+
+  path storage;
+
+  mutable std::mutex lock;
+  std::vector<Entry> entries;
+  std::unordered_map<string, uint32_t> ids;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+  // Bumped whenever save renumbers the ids.
+  uint32_t epoch;
+
+  // Files seen by the running build, entries missing from it are dropped.
+  std::unordered_set<string> visited;
+  std::atomic<size_t> pending;
+  std::atomic<bool> building;
+  std::atomic<bool> built;
+};
+
+} // namespace Text
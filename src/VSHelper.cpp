@@ -1,42 +1,84 @@
 #include "VSHelper.h"
 #include "Constants.h"
+#include "MappedFile.h"
+#include "SolutionCache.h"
+#include "SolutionFiles.h"
+#include "StorageFile.h"
+#include "ThreadPool.h"
 #include "Tooling.h"
+#include "XmlTokenizer.h"
+#include <algorithm>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace Helper {
 
+// A project while the solution is read. Once every one is known they are
+// laid out as the solution's projects, in the same order.
 struct ProjectWrapper {
-  Project::VSProject *project = nullptr;
+  string name = {};
+  string path = {};
+  string id = {};
+  string typeId = {};
+  bool isFolder = false;
   bool touched = false;
+  std::vector<Project::ProjectIndex> childs = {};
+  // Interned as they are read.
+  std::vector<Project::StringIndex> references = {};
+  std::vector<Project::StringIndex> compiles = {};
+  std::vector<Project::StringIndex> nones = {};
+  std::vector<Project::StringIndex> contents = {};
+  std::vector<Project::StringIndex> pages = {};
+  std::vector<Project::StringIndex> packageReferences = {};
+  // Ids of referenced projects, resolved once every project is known.
+  std::vector<std::string> referenceIds = {};
+  // Referenced project files, for references that come without an id.
+  std::vector<std::string> referencePaths = {};
+  // Directories the globs of the project walked.
+  std::vector<SolutionCache::Directory> walked = {};
 };
 
+// Matches Project::ItemLists.
+static std::vector<Project::StringIndex> ProjectWrapper::*const wrapperLists[] = {
+    &ProjectWrapper::references, &ProjectWrapper::compiles,
+    &ProjectWrapper::nones,      &ProjectWrapper::contents,
+    &ProjectWrapper::pages,      &ProjectWrapper::packageReferences};
+
 #if DEBUG
-void print(std::vector<Project::VSProject *> &projects, int intent) {
-  for (auto &p : projects) {
+void print(const Project::VSSolution &sln,
+           const std::vector<Project::ProjectIndex> &projects, int intent) {
+  for (auto index : projects) {
+    auto &p = sln.projects[index];
     for (int i = 0; i < intent; i++) {
       std::cout << "\t";
     }
 
-    std::cout << p->name << " is Folder: " << p->isFolder << std::endl;
+    std::cout << sln.text(p.name) << " is Folder: " << p.isFolder << std::endl;
 
-    print(p->childs, intent + 1);
+    auto childs = sln[p.childs];
+    print(sln, {childs.begin(), childs.end()}, intent + 1);
   }
 }
 #endif
 
 void addToProject(const string &parentId, const string &childId,
-                  std::map<std::string, ProjectWrapper *> &wrappers) {
-  auto parent = wrappers[parentId];
-  auto child = wrappers[childId];
-  child->touched = true;
-  parent->project->childs.emplace_back(child->project);
+                  std::vector<ProjectWrapper> &wrappers,
+                  std::unordered_map<std::string, Project::ProjectIndex> &ids) {
+  auto parent = ids.find(parentId);
+  auto child = ids.find(childId);
+  if (parent == ids.end() || child == ids.end()) {
+    return;
+  }
+  wrappers[child->second].touched = true;
+  wrappers[parent->second].childs.push_back(child->second);
 }
 
-Project::VSProject *createProjectFromLine(std::string &line, path &slnPath) {
-  auto project = new Project::VSProject;
-
+void createProjectFromLine(std::string &line, path &slnPath,
+                           ProjectWrapper &project) {
   auto typeId = line.substr(10, 36);
   auto nameStart = 53;
   auto nameEnd = line.find_first_of("\",", nameStart);
@@ -47,55 +89,462 @@ Project::VSProject *createProjectFromLine(std::string &line, path &slnPath) {
   auto path = slnPath.parent_path().append(partialPath);
   auto id = line.substr(pathEnd + 5, 36);
 
-  project->id = id;
-  project->name = name;
-  project->path = path.string();
-  project->directory = std::filesystem::directory_entry(path.parent_path());
-  project->typeId = typeId;
-  project->isFolder = line.find(Helper::Constants::VS_FOLDER_ID) !=
-                       std::string::npos;
+  project.id = id;
+  project.name = name;
+  project.path = path.string();
+  project.typeId = typeId;
+  project.isFolder = line.find(Helper::Constants::VS_FOLDER_ID) !=
+                     std::string::npos;
+}
 
-  return project;
+static char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
 }
 
-void parseProject(Project::VSProject *project,
-                  std::map<string, ProjectWrapper *> &wrappers) {
-  std::string currentLine;
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(),
+                    [](char x, char y) { return lower(x) == lower(y); });
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static std::string_view trim(std::string_view text) {
+  while (!text.empty() && isSpace(text.front())) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && isSpace(text.back())) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+// Case insensitive like the file system MSBuild was written for. Both sides
+// use '/'; * and ? stay within a directory, **/ spans any number of them.
+static bool matchGlob(std::string_view pattern, std::string_view file) {
+  while (!pattern.empty()) {
+    if (pattern.starts_with("**")) {
+      pattern.remove_prefix(2);
+      if (pattern.empty()) {
+        return true;
+      }
+      if (pattern[0] == '/') {
+        pattern.remove_prefix(1);
+      }
+      for (size_t i = 0;;) {
+        if (matchGlob(pattern, file.substr(i))) {
+          return true;
+        }
+        i = file.find('/', i);
+        if (i == std::string_view::npos) {
+          return false;
+        }
+        i++;
+      }
+    }
+
+    if (pattern[0] == '*') {
+      pattern.remove_prefix(1);
+      for (size_t i = 0;; i++) {
+        if (matchGlob(pattern, file.substr(i))) {
+          return true;
+        }
+        if (i == file.size() || file[i] == '/') {
+          return false;
+        }
+      }
+    }
+
+    if (file.empty()) {
+      return false;
+    }
+    if (pattern[0] == '?' ? file[0] == '/'
+                          : lower(pattern[0]) != lower(file[0])) {
+      return false;
+    }
+    pattern.remove_prefix(1);
+    file.remove_prefix(1);
+  }
+  return file.empty();
+}
+
+static Project::StringIndex intern(std::string_view text) {
+  return StringInterner::shared().intern(text);
+}
+
+static std::string_view text(Project::StringIndex index) {
+  return StringInterner::shared()[index];
+}
+
+static bool matchesAny(const std::vector<string> &patterns,
+                       std::string_view file) {
+  return std::any_of(patterns.begin(), patterns.end(),
+                     [&](const string &pattern) {
+                       return matchGlob(pattern, file);
+                     });
+}
+
+static string slashes(std::string_view text, char to) {
+  string result(text);
+  std::replace(result.begin(), result.end(), to == '/' ? '\\' : '/', to);
+  return result;
+}
+
+static bool isGlob(std::string_view pattern) {
+  return std::any_of(pattern.begin(), pattern.end(),
+                     [](char c) { return c == '*' || c == '?'; });
+}
+
+// Items of one kind. Removes are kept because they also apply to the SDK
+// default items, which are only added once the whole file is read.
+struct ItemList {
+  std::vector<Project::StringIndex> *items;
+  std::vector<string> removes = {};
+};
+
+// Files below the directories globs start from, walked at most once per
+// project and directory.
+struct GlobFiles {
+  path directory;
+  std::vector<SolutionCache::Directory> *stamps;
+  std::map<string, std::vector<string>> walked = {};
+
+  const std::vector<string> &below(const string &base) {
+    auto existing = walked.find(base);
+    if (existing != walked.end()) {
+      return existing->second;
+    }
+
+    auto &files = walked[base];
+    auto root = (directory / base).lexically_normal();
+    walk(root, root, files);
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  // Stamped before listing, so a file added meanwhile shows up next time.
+  void walk(const path &root, const path &current,
+            std::vector<string> &files) {
+    uint64_t stamp;
+    if (directoryStamp(current, stamp)) {
+      stamps->push_back({intern(current.string()), stamp});
+    }
+
+    std::error_code ec;
+    for (auto &entry : directory_iterator(current, ec)) {
+      auto name = entry.path().filename().string();
+      if (entry.is_directory(ec)) {
+        if (!Text::SolutionFiles::skipDirectory(name)) {
+          walk(root, entry.path(), files);
+        }
+      } else if (entry.is_regular_file(ec)) {
+        files.push_back(entry.path().lexically_relative(root).generic_string());
+      }
+    }
+  }
+};
+
+// The part of pattern in front of its first directory with a wildcard, with
+// '/' separators and no trailing one.
+static string globBase(const string &pattern) {
+  auto wildcard = pattern.find_first_of("*?");
+  auto slash = pattern.rfind('/', wildcard);
+  return slash == string::npos ? string() : pattern.substr(0, slash);
+}
+
+static void expandGlob(const string &pattern, GlobFiles &globs,
+                       const std::vector<string> &removes,
+                       std::vector<Project::StringIndex> &items) {
+  // Properties are not evaluated, so the files cannot be known.
+  if (pattern.find("$(") != string::npos) {
+    return;
+  }
+
+  auto base = globBase(pattern);
+  auto rest =
+      std::string_view(pattern).substr(base.empty() ? 0 : base.size() + 1);
+  for (auto &file : globs.below(base)) {
+    if (!matchGlob(rest, file)) {
+      continue;
+    }
+
+    auto item = base.empty() ? file : base + "/" + file;
+    if (!matchesAny(removes, item)) {
+      items.push_back(intern(slashes(item, '\\')));
+    }
+  }
+}
+
+// Entities are rare in item values, most are used straight from the file.
+static std::string_view decoded(std::string_view raw, string &storage) {
+  if (raw.find('&') == std::string_view::npos) {
+    return raw;
+  }
+  storage.clear();
+  XmlTokenizer::decode(raw, storage);
+  return storage;
+}
+
+// Item values are lists separated by ';'.
+template <typename F> static void forEachItem(std::string_view value, F f) {
+  while (!value.empty()) {
+    auto separator = value.find(';');
+    auto item = trim(value.substr(0, separator));
+    if (!item.empty()) {
+      f(item);
+    }
+    if (separator == std::string_view::npos) {
+      break;
+    }
+    value.remove_prefix(separator + 1);
+  }
+}
+
+static string projectKey(const path &file) {
+  auto key = path(slashes(file.string(), '/')).lexically_normal().string();
+  std::transform(key.begin(), key.end(), key.begin(), lower);
+  return key;
+}
+
+void parseProject(ProjectWrapper *project) {
+  PROFILE_START;
+  MappedFile mapped;
+  if (!mapped.open(project->path)) {
+    return;
+  }
+
+  ItemList compiles{&project->compiles};
+  ItemList references{&project->references};
+  ItemList packageReferences{&project->packageReferences};
+  ItemList contents{&project->contents};
+  ItemList nones{&project->nones};
+  ItemList pages{&project->pages};
+  const std::pair<std::string_view, ItemList *> lists[] = {
+      {"Compile", &compiles},   {"Reference", &references},
+      {"PackageReference", &packageReferences},
+      {"Content", &contents},   {"None", &nones},
+      {"Page", &pages}};
+
+  GlobFiles globs{path(project->path).parent_path(), &project->walked};
+  bool sdk = false;
+  bool defaultItems = true;
+  bool defaultCompileItems = true;
+  bool defaultPageItems = true;
+  bool useWpf = false;
+
+  // Element the next text belongs to, and the ProjectReference being read.
+  std::string_view element;
+  string referencePath;
+  string referenceId;
   bool inProjectReference = false;
-  std::ifstream projectStream(project->path);
-  if (projectStream.is_open()) {
-    while (std::getline(projectStream, currentLine)) {
+  string value;
+  std::vector<string> excludes;
 
-      if (inProjectReference) {
+  XmlTokenizer xml(mapped.data, mapped.size);
+  for (auto token = xml.next(); token != XmlTokenizer::Token::End;
+       token = xml.next()) {
+    if (token == XmlTokenizer::Token::Close) {
+      if (xml.name == "ProjectReference" && inProjectReference) {
         inProjectReference = false;
-        auto start = currentLine.find_first_of('{') + 1;
-        auto end = currentLine.find_first_of('}', start);
-        auto id = currentLine.substr(start, end - start);
-
-        // TODO: Speed
-        // TODO: Else -> Project no in current sln
-        if (wrappers.contains(id)) {
-          project->projectReferences.emplace_back(wrappers[id]->project);
+        if (!referenceId.empty()) {
+          project->referenceIds.push_back(referenceId);
+        } else if (!referencePath.empty()) {
+          project->referencePaths.push_back(referencePath);
         }
-      } else if (currentLine.find("Include") != string::npos) {
-        auto start = currentLine.find_first_of('<') + 1;
-        auto end = currentLine.find_first_of(' ', start);
-        auto tag = currentLine.substr(start, end - start);
-        auto contentStart = currentLine.find_first_of('\"') + 1;
-        auto contentEnd = currentLine.find_first_of('\"', contentStart);
-        auto content =
-            currentLine.substr(contentStart, contentEnd - contentStart);
-
-        if (tag == "Reference") {
-          project->references.push_back(content);
-        } else if (tag == "PackageReference") {
-          project->packageReferences.push_back(content);
-        } else if (tag == "ProjectReference") {
-          inProjectReference = true;
+      }
+      element = {};
+      continue;
+    }
+
+    if (token == XmlTokenizer::Token::Text) {
+      auto text = trim(xml.text);
+      if (element.empty() || text.empty()) {
+        continue;
+      }
+
+      if (inProjectReference && element == "Project") {
+        auto start = text.find('{');
+        auto end = text.find('}', start);
+        if (start != std::string_view::npos && end != std::string_view::npos) {
+          referenceId = string(text.substr(start + 1, end - start - 1));
         }
+      } else if (element == "EnableDefaultItems") {
+        defaultItems = !equalsIgnoreCase(text, "false");
+      } else if (element == "EnableDefaultCompileItems") {
+        defaultCompileItems = !equalsIgnoreCase(text, "false");
+      } else if (element == "EnableDefaultPageItems") {
+        defaultPageItems = !equalsIgnoreCase(text, "false");
+      } else if (element == "UseWPF") {
+        useWpf = equalsIgnoreCase(text, "true");
+      }
+      continue;
+    }
+
+    element = xml.selfClosing ? std::string_view() : xml.name;
+    std::string_view attribute;
+    auto sdkAttribute = xml.name == "Sdk" ? "Name" : "Sdk";
+    if ((xml.name == "Project" || xml.name == "Sdk" || xml.name == "Import") &&
+        XmlTokenizer::attribute(xml.attributes, sdkAttribute, attribute)) {
+      sdk = true;
+      continue;
+    }
+
+    if (xml.name == "ProjectReference") {
+      referencePath.clear();
+      referenceId.clear();
+      if (XmlTokenizer::attribute(xml.attributes, "Include", attribute)) {
+        XmlTokenizer::decode(attribute, referencePath);
+      }
+      inProjectReference = !xml.selfClosing;
+      if (xml.selfClosing && !referencePath.empty()) {
+        project->referencePaths.push_back(referencePath);
+      }
+      continue;
+    }
+
+    auto list =
+        std::find_if(std::begin(lists), std::end(lists),
+                     [&](auto &entry) { return entry.first == xml.name; });
+    if (list == std::end(lists)) {
+      continue;
+    }
+
+    std::string_view include, exclude, remove, attributeName;
+    auto attributes = xml.attributes;
+    while (XmlTokenizer::nextAttribute(attributes, attributeName, attribute)) {
+      if (attributeName == "Include") {
+        include = attribute;
+      } else if (attributeName == "Exclude") {
+        exclude = attribute;
+      } else if (attributeName == "Remove") {
+        remove = attribute;
       }
     }
-    projectStream.close();
+
+    auto &items = *list->second;
+    if (!include.empty()) {
+      excludes.clear();
+      forEachItem(decoded(exclude, value), [&](std::string_view item) {
+        excludes.push_back(slashes(item, '/'));
+      });
+
+      forEachItem(decoded(include, value), [&](std::string_view item) {
+        if (isGlob(item)) {
+          expandGlob(slashes(item, '/'), globs, excludes, *items.items);
+        } else if (excludes.empty() ||
+                   !matchesAny(excludes, slashes(item, '/'))) {
+          items.items->push_back(intern(item));
+        }
+      });
+    } else if (!remove.empty()) {
+      forEachItem(decoded(remove, value), [&](std::string_view item) {
+        auto pattern = slashes(item, '/');
+        std::erase_if(*items.items, [&](Project::StringIndex existing) {
+          return matchGlob(pattern, slashes(text(existing), '/'));
+        });
+        items.removes.push_back(std::move(pattern));
+      });
+    }
+  }
+
+  // SDK projects pick up their sources from the directory unless told not
+  // to. The defaults are imported before the project body, so they go first.
+  if (sdk && defaultItems) {
+    auto extension = path(project->path).extension().string();
+    auto language = equalsIgnoreCase(extension, ".csproj")   ? "cs"
+                    : equalsIgnoreCase(extension, ".vbproj") ? "vb"
+                                                             : "";
+    auto addDefaults = [&](ItemList &list, const string &pattern) {
+      std::vector<Project::StringIndex> defaults;
+      expandGlob(pattern, globs, list.removes, defaults);
+      list.items->insert(list.items->begin(), defaults.begin(), defaults.end());
+    };
+    if (defaultCompileItems && *language) {
+      addDefaults(compiles, string("**/*.") + language);
+    }
+    if (defaultPageItems && useWpf) {
+      // App.xaml is the application definition, not a page.
+      pages.removes.push_back("App.xaml");
+      addDefaults(pages, "**/*.xaml");
+    }
+  }
+}
+
+// Takes the items of a project that did not change from the cache.
+static void restoreProject(const SolutionCache &cache,
+                           Project::ProjectIndex index, ProjectWrapper &project) {
+  auto &cached = cache.snapshot;
+  auto &entry = cached.projects[index];
+  project.walked = cache.stamps[index].directories;
+  for (size_t list = 0; list < std::size(Project::ItemLists); list++) {
+    auto items = cached[entry.*Project::ItemLists[list]];
+    (project.*wrapperLists[list]).assign(items.begin(), items.end());
+  }
+  for (auto referenced : cached[entry.projectReferences]) {
+    project.referenceIds.emplace_back(
+        cached.text(cached.projects[referenced].id));
+  }
+}
+
+// Lays the wrappers out as the solution's projects. References to projects
+// outside the solution are dropped.
+static void buildSolution(std::vector<ProjectWrapper> &wrappers,
+                          const std::unordered_map<std::string,
+                                                   Project::ProjectIndex> &ids,
+                          Project::VSSolution &sln) {
+  PROFILE_START;
+  std::unordered_map<string, Project::ProjectIndex> byPath;
+  for (Project::ProjectIndex i = 0; i < wrappers.size(); i++) {
+    if (!wrappers[i].isFolder) {
+      byPath[projectKey(wrappers[i].path)] = i;
+    }
+  }
+
+  auto range = [&](auto &&values) {
+    auto first = (uint32_t)sln.indices.size();
+    for (auto value : values) {
+      sln.indices.push_back(value);
+    }
+    return Project::IndexRange{first, (uint32_t)sln.indices.size() - first};
+  };
+
+  sln.projects.resize(wrappers.size());
+  std::vector<Project::ProjectIndex> references;
+  for (Project::ProjectIndex i = 0; i < wrappers.size(); i++) {
+    auto &wrapper = wrappers[i];
+    auto &project = sln.projects[i];
+    project.name = intern(wrapper.name);
+    project.path = intern(wrapper.path);
+    project.id = intern(wrapper.id);
+    project.typeId = intern(wrapper.typeId);
+    project.isFolder = wrapper.isFolder;
+    project.childs = range(wrapper.childs);
+
+    references.clear();
+    for (auto &id : wrapper.referenceIds) {
+      auto referenced = ids.find(id);
+      if (referenced != ids.end()) {
+        references.push_back(referenced->second);
+      }
+    }
+    auto directory = path(wrapper.path).parent_path();
+    for (auto &file : wrapper.referencePaths) {
+      auto referenced = byPath.find(projectKey(directory / slashes(file, '/')));
+      if (referenced != byPath.end()) {
+        references.push_back(referenced->second);
+      }
+    }
+    project.projectReferences = range(references);
+
+    for (size_t list = 0; list < std::size(Project::ItemLists); list++) {
+      project.*Project::ItemLists[list] = range(wrapper.*wrapperLists[list]);
+    }
+
+    if (!wrapper.touched) {
+      sln.roots.push_back(i);
+    }
   }
 }
 
@@ -106,27 +555,34 @@ Project::VSSolution *VSHelper::parseVSsln(
   if (progessCallback) {
     progessCallback(.0f, (char *)"Loading Solution");
   }
-  auto sln = new Project::VSSolution;
-
-  sln->path = slnFilePath;
-
   auto slnPath = path(slnFilePath);
-
   auto name = slnPath.stem().string();
-  sln->name = name;
+
+  // Kept in the solution's .vs folder, next to Visual Studio's.
+  SolutionCache cache(slnPath.parent_path() / ".vs" / (name + ".solution"));
+  SolutionCache::Stamp slnStamp;
+  fileStamp(slnPath, slnStamp.size, slnStamp.stamp);
+  if (cache.load()) {
+    if (auto cached = cache.solution(slnFilePath, slnStamp)) {
+      if (progessCallback) {
+        progessCallback(1.f, (char *)"Loading Solution");
+      }
+      return cached;
+    }
+  }
 
   std::string currentLine;
   std::ifstream slnStream(slnFilePath);
-  std::map<std::string, ProjectWrapper *> wrappers;
+  std::vector<ProjectWrapper> wrappers;
+  std::unordered_map<std::string, Project::ProjectIndex> ids;
 
   bool handleStructure = false;
   if (slnStream.is_open()) {
     while (std::getline(slnStream, currentLine)) {
       if (currentLine.starts_with("Project")) {
-        auto wrapper = new ProjectWrapper;
-        wrapper->project = createProjectFromLine(currentLine, slnPath);
-        wrapper->touched = false;
-        wrappers[wrapper->project->id] = wrapper;
+        auto &wrapper = wrappers.emplace_back();
+        createProjectFromLine(currentLine, slnPath, wrapper);
+        ids[wrapper.id] = (Project::ProjectIndex)(wrappers.size() - 1);
       }
 
       if (currentLine.starts_with("\tGlobalSection(NestedProjects)")) {
@@ -142,28 +598,70 @@ Project::VSSolution *VSHelper::parseVSsln(
 
         auto childId = currentLine.substr(3, 36);
         auto parentId = currentLine.substr(44, 36);
-        addToProject(parentId, childId, wrappers);
+        addToProject(parentId, childId, wrappers, ids);
       }
     }
     slnStream.close();
   }
 
-  size_t counter = 0;
-  auto size = wrappers.size();
-  for (auto &wrapper : wrappers) {
-    if (progessCallback) {
-      auto text = "Loading Project " + wrapper.second->project->name;
-      progessCallback((float)counter / size, text.c_str());
+  // Project files that changed since the cache was written are parsed on
+  // the pool. Progress is reported from this thread as they finish, so it
+  // only ever moves forward.
+  std::mutex progressLock;
+  std::condition_variable progressChanged;
+  size_t parsed = 0;
+  size_t size = 0;
+  string lastParsed;
+  std::vector<SolutionCache::ProjectStamp> stamps(wrappers.size());
+  for (size_t i = 0; i < wrappers.size(); i++) {
+    auto wrapper = &wrappers[i];
+    if (wrapper->isFolder) {
+      continue;
     }
-    if (!wrapper.second->project->isFolder) {
-      parseProject(wrapper.second->project, wrappers);
+
+    auto &stamp = stamps[i].file;
+    if (fileStamp(wrapper->path, stamp.size, stamp.stamp)) {
+      auto cached = cache.find(intern(wrapper->path), stamp);
+      if (cached != Project::NoProject) {
+        restoreProject(cache, cached, *wrapper);
+        continue;
+      }
+    }
+
+    size++;
+    Helper::ThreadPool::shared().submit([&, wrapper]() {
+      parseProject(wrapper);
+
+      std::lock_guard<std::mutex> guard(progressLock);
+      parsed++;
+      lastParsed = wrapper->name;
+      progressChanged.notify_one();
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(progressLock);
+    size_t reported = 0;
+    while (reported < size) {
+      progressChanged.wait(guard, [&]() { return parsed > reported; });
+      reported = parsed;
+      if (progessCallback) {
+        auto text = "Loading Project " + lastParsed;
+        progessCallback((float)reported / size, text.c_str());
+      }
     }
+  }
+
+  auto sln = new Project::VSSolution;
+  sln->path = slnFilePath;
+  sln->name = name;
+  buildSolution(wrappers, ids, *sln);
 
-    if (!wrapper.second->touched) {
-      sln->projects.emplace_back(wrapper.second->project);
+  if (size > 0 || !(slnStamp == cache.sln)) {
+    for (size_t i = 0; i < wrappers.size(); i++) {
+      stamps[i].directories = std::move(wrappers[i].walked);
     }
-    delete wrapper.second;
-    counter++;
+    cache.save(*sln, slnStamp, stamps);
   }
   if (progessCallback) {
     progessCallback(1.f, (char *)"Loading Solution");
@@ -171,7 +669,7 @@ Project::VSSolution *VSHelper::parseVSsln(
 
 #if DEBUG
   std::cout << "SOLUTION STRUCTURE" << std::endl;
-  print(sln->projects, 0);
+  print(*sln, sln->roots, 0);
 #endif
 
   return sln;
@@ -1,30 +1,74 @@
 #pragma once
 
 #include "Constants.h"
+#include "StringInterner.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
 
 namespace Project {
 
+// Projects are numbered by their place in VSSolution::projects. Strings are
+// ids of the shared StringInterner, so equal strings have equal indices in
+// every solution.
+typedef uint32_t ProjectIndex;
+typedef uint32_t StringIndex;
+
+constexpr ProjectIndex NoProject = UINT32_MAX;
+
+// A run of VSSolution::indices.
+struct IndexRange {
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
 struct VSProject {
-  string name;
-  string path;
-  string id;
-  string typeId;
+  StringIndex name;
+  StringIndex path;
+  StringIndex id;
+  StringIndex typeId;
   bool isFolder;
-  std::vector<Project::VSProject *> childs = {};
-  std::vector<std::string> references = {};
-  std::vector<std::string> compiles = {};
-  std::vector<std::string> nones = {};
-  std::vector<std::string> contents = {};
-  std::vector<Project::VSProject *> projectReferences = {};
-  std::vector<std::string> pages = {};
-  std::vector<std::string> packageReferences = {};
-  directory_entry directory = {};
+  // Project indices.
+  IndexRange childs;
+  IndexRange projectReferences;
+  // String indices.
+  IndexRange references;
+  IndexRange compiles;
+  IndexRange nones;
+  IndexRange contents;
+  IndexRange pages;
+  IndexRange packageReferences;
 };
 
+// The item lists of a project, in the order they are stored.
+constexpr IndexRange VSProject::*ItemLists[] = {
+    &VSProject::references, &VSProject::compiles, &VSProject::nones,
+    &VSProject::contents,   &VSProject::pages,    &VSProject::packageReferences};
+
+// Projects sit in one array and refer to each other and to their strings by
+// index, so the whole solution is a handful of allocations.
 struct VSSolution {
   string name = {};
   string path = {};
-  std::vector<Project::VSProject *> projects = {};
+  std::vector<VSProject> projects = {};
+  // The projects not nested in a solution folder.
+  std::vector<ProjectIndex> roots = {};
+  // The ranges of every project, back to back.
+  std::vector<uint32_t> indices = {};
+
+  std::span<const uint32_t> operator[](IndexRange range) const {
+    return std::span<const uint32_t>(indices.data() + range.first, range.count);
+  }
+  std::string_view text(StringIndex index) const {
+    return Helper::StringInterner::shared()[index];
+  }
+  const char *c_str(StringIndex index) const {
+    return Helper::StringInterner::shared().c_str(index);
+  }
+  ::path directory(const VSProject &project) const {
+    return ::path(text(project.path)).parent_path();
+  }
 };
 
 }; // namespace Project
@@ -0,0 +1,196 @@
+#include "XmlTokenizer.h"
+#include <cstring>
+
+namespace Helper {
+
+static inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool isNameEnd(char c) {
+  return isSpace(c) || c == '>' || c == '/';
+}
+
+bool XmlTokenizer::skipPast(std::string_view terminator) {
+  auto remaining = std::string_view(at, end - at);
+  auto found = remaining.find(terminator);
+  if (found == std::string_view::npos) {
+    at = end;
+    return false;
+  }
+  at += found + terminator.size();
+  return true;
+}
+
+XmlTokenizer::Token XmlTokenizer::next() {
+  while (at < end) {
+    if (*at != '<') {
+      auto open = (const char *)std::memchr(at, '<', end - at);
+      auto stop = open ? open : end;
+      text = std::string_view(at, stop - at);
+      at = stop;
+      return Token::Text;
+    }
+
+    auto remaining = std::string_view(at, end - at);
+    if (remaining.starts_with("<!--")) {
+      at += 4;
+      skipPast("-->");
+      continue;
+    }
+    if (remaining.starts_with("<![CDATA[")) {
+      auto start = at + 9;
+      at = start;
+      auto closed = skipPast("]]>");
+      text = std::string_view(start, (closed ? at - 3 : end) - start);
+      return Token::Text;
+    }
+    if (remaining.starts_with("<?") || remaining.starts_with("<!")) {
+      skipPast(">");
+      continue;
+    }
+
+    auto closing = remaining.size() > 1 && remaining[1] == '/';
+    auto nameStart = at + (closing ? 2 : 1);
+    auto nameEnd = nameStart;
+    while (nameEnd < end && !isNameEnd(*nameEnd)) {
+      nameEnd++;
+    }
+    name = std::string_view(nameStart, nameEnd - nameStart);
+
+    // Quoted values may contain '>', so the end of the tag is found by
+    // stepping over them.
+    auto cursor = nameEnd;
+    while (cursor < end && *cursor != '>') {
+      if (*cursor == '"' || *cursor == '\'') {
+        auto quote = (const char *)std::memchr(cursor + 1, *cursor,
+                                               end - cursor - 1);
+        cursor = quote ? quote : end - 1;
+      }
+      cursor++;
+    }
+    if (cursor == end || name.empty()) {
+      at = end;
+      return Token::End;
+    }
+
+    at = cursor + 1;
+    if (closing) {
+      return Token::Close;
+    }
+
+    selfClosing = cursor[-1] == '/' && cursor - 1 >= nameEnd;
+    auto attributesEnd = selfClosing ? cursor - 1 : cursor;
+    attributes = std::string_view(nameEnd, attributesEnd - nameEnd);
+    return Token::Open;
+  }
+  return Token::End;
+}
+
+bool XmlTokenizer::nextAttribute(std::string_view &attributes,
+                                 std::string_view &name,
+                                 std::string_view &value) {
+  auto at = attributes.data();
+  auto end = at + attributes.size();
+  while (at < end) {
+    while (at < end && isSpace(*at)) {
+      at++;
+    }
+    auto nameStart = at;
+    auto equals = (const char *)std::memchr(at, '=', end - at);
+    if (!equals) {
+      break;
+    }
+
+    auto nameEnd = equals;
+    while (nameEnd > nameStart && isSpace(nameEnd[-1])) {
+      nameEnd--;
+    }
+    at = equals + 1;
+    while (at < end && isSpace(*at)) {
+      at++;
+    }
+    if (at == end || (*at != '"' && *at != '\'')) {
+      break;
+    }
+
+    auto valueEnd = (const char *)std::memchr(at + 1, *at, end - at - 1);
+    if (!valueEnd) {
+      break;
+    }
+    name = std::string_view(nameStart, nameEnd - nameStart);
+    value = std::string_view(at + 1, valueEnd - at - 1);
+    attributes = std::string_view(valueEnd + 1, end - valueEnd - 1);
+    return true;
+  }
+  attributes = {};
+  return false;
+}
+
+bool XmlTokenizer::attribute(std::string_view attributes, std::string_view name,
+                             std::string_view &value) {
+  std::string_view attributeName;
+  while (nextAttribute(attributes, attributeName, value)) {
+    if (attributeName == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void XmlTokenizer::decode(std::string_view raw, string &out) {
+  size_t i = 0;
+  while (i < raw.size()) {
+    auto amp = raw.find('&', i);
+    if (amp == std::string_view::npos) {
+      out.append(raw.substr(i));
+      return;
+    }
+    out.append(raw.substr(i, amp - i));
+
+    auto semicolon = raw.find(';', amp);
+    if (semicolon == std::string_view::npos) {
+      out.append(raw.substr(amp));
+      return;
+    }
+
+    auto entity = raw.substr(amp + 1, semicolon - amp - 1);
+    char c = 0;
+    if (entity == "lt") {
+      c = '<';
+    } else if (entity == "gt") {
+      c = '>';
+    } else if (entity == "amp") {
+      c = '&';
+    } else if (entity == "quot") {
+      c = '"';
+    } else if (entity == "apos") {
+      c = '\'';
+    } else if (entity.size() > 1 && entity[0] == '#') {
+      auto hex = entity[1] == 'x' || entity[1] == 'X';
+      unsigned code = 0;
+      for (size_t j = hex ? 2 : 1; j < entity.size(); j++) {
+        auto d = entity[j];
+        unsigned digit = d >= '0' && d <= '9'   ? d - '0'
+                         : hex && d >= 'a' && d <= 'f' ? d - 'a' + 10
+                         : hex && d >= 'A' && d <= 'F' ? d - 'A' + 10
+                                                      : 128;
+        code = code * (hex ? 16 : 10) + digit;
+        if (digit >= (hex ? 16u : 10u) || code >= 128) {
+          code = 0;
+          break;
+        }
+      }
+      c = (char)code;
+    }
+
+    if (c) {
+      out.push_back(c);
+    } else {
+      out.append(raw.substr(amp, semicolon - amp + 1));
+    }
+    i = semicolon + 1;
+  }
+}
+
+} // namespace Helper
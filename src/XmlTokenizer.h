@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Constants.h"
+#include <cstddef>
+#include <string_view>
+
+namespace Helper {
+
+// Single pass pull tokenizer for the XML found in project files. Tokens are
+// views into the buffer, nothing is allocated or copied. Comments,
+// processing instructions and doctypes are skipped, CDATA sections come back
+// as text. Entities are left as they are, decode resolves the predefined
+// ones when a value is kept. Malformed input ends the token stream early.
+struct XmlTokenizer {
+  XmlTokenizer(const char *data, size_t size)
+      : at(data), end(data + size), selfClosing(false) {}
+
+  enum class Token { Open, Close, Text, End };
+
+  // After Open, name and attributes are set and selfClosing tells whether
+  // no Close follows. After Close only name is set, after Text only text.
+  Token next();
+
+  // Takes the first attribute off the raw attributes of an Open token, false
+  // once there are none left.
+  static bool nextAttribute(std::string_view &attributes,
+                            std::string_view &name, std::string_view &value);
+  // Looks up an attribute in the raw attributes of an Open token.
+  static bool attribute(std::string_view attributes, std::string_view name,
+                        std::string_view &value);
+  // Appends raw with &lt; &gt; &amp; &quot; &apos; and numeric references
+  // below 128 resolved.
+  static void decode(std::string_view raw, string &out);
+
+  bool skipPast(std::string_view terminator);
+
+  const char *at;
+  const char *end;
+
+  std::string_view name;
+  std::string_view attributes;
+  std::string_view text;
+  bool selfClosing;
+};
+
+} // namespace Helper
@@ -0,0 +1,65 @@
+// Checks of Text::Regex that don't need the editor. Run by ctest when the
+// project is configured with JOY_SHARP_TOOLS, see tools/CMakeLists.txt.
+
+#include "Regex.h"
+#include "TextReplace.h"
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    std::printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+static string replaceAll(const char *pattern, const char *replacement,
+                         const char *text) {
+  Text::Replacer replacer;
+  string error, out;
+  if (!replacer.compile(pattern, replacement, true, true, error)) {
+    return "error: " + error;
+  }
+  return replacer.replace(text, out) > 0 ? out : string(text);
+}
+
+int main() {
+  // Higher priority threads run to the end of the text after every match
+  // here. Carried over between matches this stays linear, searching again
+  // from each match took minutes; the ctest timeout catches that.
+  {
+    Text::Regex regex;
+    string error;
+    regex.compile("a.*b|a", true, error);
+    string text(1 << 20, 'a');
+    std::vector<size_t> ranges;
+    regex.findAll(text, ranges);
+    check(ranges.size() == text.size() * 2, "a.*b|a finds every a");
+  }
+
+  // Empty matches get the replacement inserted, as in JavaScript.
+  check(replaceAll("^", "// ", "a\nb\n") == "// a\n// b\n// ", "^");
+  check(replaceAll("\\b", "_", "ab cd") == "_ab_ _cd_", "\\b");
+  check(replaceAll("$", ";", "x\ny") == "x;\ny;", "$");
+  check(replaceAll("a|", "X", "ab") == "XXbX", "a|");
+  check(replaceAll("x*", "-", "abc") == "-a-b-c-", "x*");
+  check(replaceAll("(\\w+)=(\\w+)", "$2=$1", "a=b, cd=ef") == "b=a, ef=cd",
+        "groups");
+
+  // Nested repetitions multiply, the program size is what is bounded.
+  {
+    Text::Regex regex;
+    string error;
+    check(!regex.compile("((a{1000}){1000}){1000}", true, error),
+          "nested repetition rejected");
+    check(!regex.compile(string(300, '(') + "a" + string(300, ')'), true,
+                         error),
+          "deep nesting rejected");
+  }
+
+  if (failures == 0) {
+    std::printf("ok\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
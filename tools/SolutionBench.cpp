@@ -0,0 +1,194 @@
+// Loads a generated solution and reports how fast the project files
+// tokenize, how long a load takes without and with the snapshot in .vs,
+// and how much resident memory a load adds. Built with JOY_SHARP_TOOLS.
+//
+//   solution_bench [projects] [directory]
+//
+// Defaults to 1000 projects in the temp directory. Each one has the same
+// References and PackageReferences, 300 Compile items, a few other items
+// and a ProjectReference to the one before it.
+
+#include "StringInterner.h"
+#include "VSHelper.h"
+#include "XmlTokenizer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// 0 where the platform has no cheap way to ask.
+static size_t residentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                           sizeof(counters))) {
+    return counters.WorkingSetSize;
+  }
+  return 0;
+#elif defined(__linux__)
+  size_t total = 0, resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  if (statm >> total >> resident) {
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+  }
+  return 0;
+#else
+  return 0;
+#endif
+}
+
+static string projectName(int index) { return "P" + std::to_string(index); }
+
+static path projectFile(int index) {
+  return path(projectName(index)) / (projectName(index) + ".csproj");
+}
+
+static void writeFile(const path &file, const string &text) {
+  std::filesystem::create_directories(file.parent_path());
+  std::ofstream out(file, std::ios::binary | std::ios::trunc);
+  out << text;
+}
+
+static string projectText(int index) {
+  std::ostringstream out;
+  out << "<Project ToolsVersion=\"15.0\">\n  <ItemGroup>\n";
+  static const char *references[] = {"System",     "System.Core",
+                                     "System.Xml", "System.Data",
+                                     "System.Net", "Microsoft.CSharp",
+                                     "WindowsBase", "PresentationCore"};
+  for (auto reference : references) {
+    out << "    <Reference Include=\"" << reference << "\" />\n";
+  }
+  for (int i = 0; i < 6; i++) {
+    out << "    <PackageReference Include=\"Package" << i << "\">\n"
+        << "      <Version>1." << i << ".0</Version>\n"
+        << "    </PackageReference>\n";
+  }
+  for (int i = 0; i < 300; i++) {
+    out << "    <Compile Include=\"Folder" << i % 10 << "\\File" << i
+        << ".cs\" />\n";
+  }
+  out << "    <Content Include=\"readme.txt\" />\n"
+      << "    <None Include=\"app.config\" />\n"
+      << "    <Page Include=\"MainWindow.xaml\" />\n";
+  if (index > 0) {
+    out << "    <ProjectReference Include=\"..\\" << projectName(index - 1)
+        << "\\" << projectName(index - 1) << ".csproj\">\n"
+        << "      <Name>" << projectName(index - 1) << "</Name>\n"
+        << "    </ProjectReference>\n";
+  }
+  out << "  </ItemGroup>\n</Project>\n";
+  return out.str();
+}
+
+static path generate(const path &directory, int projects) {
+  std::filesystem::remove_all(directory);
+  std::ostringstream sln;
+  sln << "Microsoft Visual Studio Solution File, Format Version 12.00\n";
+  char id[40];
+  for (int i = 0; i < projects; i++) {
+    std::snprintf(id, sizeof(id), "%08X-0000-0000-0000-%012X", i, i);
+    sln << "Project(\"{FAE04EC0-301F-11D3-BF4B-00C04F79EFBC}\") = \""
+        << projectName(i) << "\", \"" << projectFile(i).string() << "\", \"{"
+        << id << "}\"\nEndProject\n";
+    writeFile(directory / projectFile(i), projectText(i));
+  }
+  auto slnFile = directory / "Bench.sln";
+  writeFile(slnFile, sln.str());
+  return slnFile;
+}
+
+static void tokenize(const path &directory, int projects) {
+  std::vector<string> files;
+  size_t bytes = 0;
+  for (int i = 0; i < projects; i++) {
+    std::ifstream in(directory / projectFile(i), std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    files.push_back(text.str());
+    bytes += files.back().size();
+  }
+
+  // Passes over the files already in memory, until a second is spent.
+  size_t tokens = 0;
+  int passes = 0;
+  auto start = Clock::now();
+  do {
+    for (auto &file : files) {
+      Helper::XmlTokenizer xml(file.data(), file.size());
+      while (xml.next() != Helper::XmlTokenizer::Token::End) {
+        tokens++;
+      }
+    }
+    passes++;
+  } while (millisecondsSince(start) < 1000.0);
+  auto elapsed = millisecondsSince(start);
+
+  std::printf("tokenizer: %.1f MB in %d passes, %.0f MB/s, %zu tokens per "
+              "pass\n",
+              bytes / 1e6, passes, bytes * passes / 1e3 / elapsed,
+              tokens / passes);
+}
+
+static Project::VSSolution *load(const path &slnFile, const char *what) {
+  auto before = residentBytes();
+  auto start = Clock::now();
+  auto sln = Helper::VSHelper::parseVSsln(slnFile.string(), nullptr);
+  auto elapsed = millisecondsSince(start);
+  std::printf("%-8s %8.1f ms, resident memory +%.1f MB\n", what, elapsed,
+              ((double)residentBytes() - (double)before) / 1e6);
+  return sln;
+}
+
+int main(int argc, char **argv) {
+  int projects = argc > 1 ? std::atoi(argv[1]) : 1000;
+  path directory = argc > 2 ? path(argv[2])
+                            : std::filesystem::temp_directory_path() /
+                                  "joy_sharp_bench";
+  if (projects <= 0) {
+    std::printf("usage: solution_bench [projects] [directory]\n");
+    return 1;
+  }
+
+  auto slnFile = generate(directory, projects);
+  std::printf("%d projects in %s\n", projects, directory.string().c_str());
+  tokenize(directory, projects);
+
+  // Cold parses every project file and writes the snapshot, warm only maps
+  // the snapshot, partial reparses the one project file that changed.
+  auto sln = load(slnFile, "cold");
+
+  size_t strings = 0;
+  for (auto &project : sln->projects) {
+    for (auto list : Project::ItemLists) {
+      strings += (project.*list).count;
+    }
+  }
+  std::printf("item strings %zu, distinct strings interned %u\n", strings,
+              Helper::StringInterner::shared().nextId);
+  delete sln;
+
+  delete load(slnFile, "warm");
+
+  writeFile(directory / projectFile(projects / 2),
+            projectText(projects / 2) + "\n");
+  delete load(slnFile, "partial");
+  return 0;
+}